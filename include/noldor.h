@@ -89,12 +89,17 @@ public:
     const char* what() const noexcept override;
 };
 
+// The irritants are only printed when what() is first called, so that errors
+// handled by Scheme code never pay for the external representation.
 class NOLDOR_EXPORT base_error : public noldor_exception
 {
     value _irritants;
+    mutable std::string _what;
 public:
     base_error(std::string msg, value irritants);
     value irritants() const noexcept;
+    const char *message() const noexcept;
+    const char *what() const noexcept override;
 };
 
 class NOLDOR_EXPORT type_error : public base_error
@@ -121,6 +126,13 @@ public:
     using base_error::base_error;
 };
 
+// a raise that no Scheme handler caught, the irritants are the raised object
+class NOLDOR_EXPORT raise_error : public base_error
+{
+public:
+    using base_error::base_error;
+};
+
 class NOLDOR_EXPORT runtime_error : public noldor_exception
 {
 public:
@@ -143,7 +155,7 @@ inline void check_type(bool (*predicate)(uint64_t), uint64_t val, const char *ms
     if (!predicate(val)) throw noldor::type_error(msg, val);
 }
 
-constexpr uint8_t METATYPE_VERSION = 0;
+constexpr uint8_t METATYPE_VERSION = 1;
 
 typedef void (*gc_visit_fn_t)(value *child, void *data);
 
@@ -165,6 +177,29 @@ enum typeflags {
     typeflags_none      = 0x0,
     typeflags_static    = 0x1, // GC should not reap
     typeflags_self_eval = 0x2, // evaluates to itself
+    typeflags_remembered = 0x4, // mutated without write barriers, traced by every collection
+    typeflags_movable   = 0x8, // compaction may copy it elsewhere byte for byte, see gc_pin
+};
+
+// The most common heap types carry a tag in the low bits of their boxed
+// pointer so that type predicates never need to touch the object itself.
+enum type_tag : uint8_t {
+    type_tag_none = 0,
+    type_tag_pair,
+    type_tag_symbol,
+    type_tag_string,
+    type_tag_char,
+    type_tag_vector,
+    type_tag_environment,
+    type_tag_primitive_procedure,
+    type_tag_compound_procedure,
+    type_tag_port,
+    type_tag_control_procedure,
+    type_tag_case_lambda,
+    type_tag_continuation,
+    type_tag_composable_continuation,
+    type_tag_thread,
+    type_tag_max = 0xf
 };
 
 struct NOLDOR_EXPORT metatype_t {
@@ -174,10 +209,14 @@ struct NOLDOR_EXPORT metatype_t {
     void (* const destruct)(value self);
     void (* const gc_visit)(value self, gc_visit_fn_t visitor, void *data);
     std::string (* const repr)(value self);
+
+    const type_tag tag;
 };
 
+
 NOLDOR_EXPORT void noldor_init(int argc, char **argv);
 NOLDOR_EXPORT value allocate(metatype_t *metaobject, size_t size, size_t alignment = alignof(uintptr_t));
+NOLDOR_EXPORT value allocate_cell(metatype_t *metaobject, size_t size);
 
 NOLDOR_EXPORT void register_function(const char *name, std::function<value(value)> fn);
 
@@ -192,6 +231,14 @@ inline value object_allocate(metatype_t *metaobject, T &&obj)
     return cell;
 }
 
+template <class T>
+inline value cell_allocate(metatype_t *metaobject, T &&obj)
+{
+    value cell = allocate_cell(metaobject, sizeof(T));
+    new (object_data(cell)) T(std::move(obj));
+    return cell;
+}
+
 template <class T>
 inline T object_data_as(value obj)
 {
@@ -273,10 +320,17 @@ struct NOLDOR_EXPORT dot_tag {};
     X("assq",                       assq,                       value,          value, value                ) \
     X("symbol?",                    is_symbol,                  bool,           value                       ) \
     X("symbol->string",             symbol_to_string,           std::string,    value                       ) \
-    X("string->symbol",             symbol,                     value,          std::string                 ) \
+    X("string->symbol",             string_to_symbol,           value,          std::string                 ) \
     X("char?",                      is_char,                    bool,           value                       ) \
     X("string?",                    is_string,                  bool,           value                       ) \
     X("vector?",                    is_vector,                  bool,           value                       ) \
+    X("make-vector",                make_vector,                value,          int32_t, dot_tag, value     ) \
+    X("vector-length",              vector_length,              int32_t,        value                       ) \
+    X("vector-ref",                 vector_ref,                 value,          value, int32_t              ) \
+    X("vector-set!",                vector_set,                 value,          value, int32_t, value       ) \
+    X("vector-map/par",             vector_map_par,             value,          value, value                ) \
+    X("vector-for-each/par",        vector_for_each_par,        value,          value, value                ) \
+    X("vector-reduce/par",          vector_reduce_par,          value,          value, value, value         ) \
     X("procedure?",                 is_procedure,               bool,           value                       ) \
     X("primitive-procedure?",       is_primitive_procedure,     bool,           value                       ) \
     X("compound-procedure?",        is_compound_procedure,      bool,           value                       ) \
@@ -298,6 +352,16 @@ struct NOLDOR_EXPORT dot_tag {};
     X("current-output-port",        current_output_port,        value,                                      ) \
     X("current-error-port",         current_error_port,         value,                                      ) \
     X("file-port?",                 is_file_port,               bool,           value                       ) \
+    X("port-blocking?",             is_port_blocking,           bool,           value                       ) \
+    X("set-port-blocking!",         set_port_blocking,          value,          value, value                ) \
+    X("flush-output-port",          flush_output_port,          value,          dot_tag, value              ) \
+    X("socket-port?",               is_socket_port,             bool,           value                       ) \
+    X("make-tcp-listener",          make_tcp_listener,          value,          int32_t, dot_tag, value     ) \
+    X("make-unix-listener",         make_unix_listener,         value,          std::string                 ) \
+    X("listener-port",              listener_port,              int32_t,        value                       ) \
+    X("accept",                     socket_accept,              value,          value                       ) \
+    X("tcp-connect",                tcp_connect,                value,          std::string, int32_t        ) \
+    X("unix-connect",               unix_connect,               value,          std::string                 ) \
     X("open-input-file",            open_input_file,            value,          std::string                 ) \
     X("open-binary-input-file",     open_binary_input_file,     value,          std::string                 ) \
     X("open-output-file",           open_output_file,           value,          std::string                 ) \
@@ -332,6 +396,55 @@ struct NOLDOR_EXPORT dot_tag {};
     X("current-jiffy",              current_jiffy,              int32_t,                                    ) \
     X("jiffies-per-second",         jiffies_per_second,         int32_t,                                    ) \
     X("tagged-list?",               is_tagged_list,             bool,           value, value                ) \
+    X("error-object?",              is_error_object,            bool,           value                       ) \
+    X("error-object-message",       error_object_message,       value,          value                       ) \
+    X("error-object-irritants",     error_object_irritants,     value,          value                       ) \
+    X("file-error?",                is_file_error,              bool,           value                       ) \
+    X("read-error?",                is_read_error,              bool,           value                       ) \
+    X("make-thread",                make_thread,                value,          value, dot_tag, value       ) \
+    X("thread?",                    is_thread,                  bool,           value                       ) \
+    X("current-thread",             current_thread,             value,                                      ) \
+    X("thread-name",                thread_name,                value,          value                       ) \
+    X("thread-start!",              thread_start,               value,          value                       ) \
+    X("make-os-thread",             make_os_thread,             value,          value                       ) \
+    X("os-thread?",                 is_os_thread,               bool,           value                       ) \
+    X("os-thread-join!",            os_thread_join,             value,          value                       ) \
+    X("make-isolate",               make_isolate,               value,          value, dot_tag, value       ) \
+    X("isolate?",                   is_isolate,                 bool,           value                       ) \
+    X("isolate-join!",              isolate_join,               value,          value                       ) \
+    X("make-future",                make_future,                value,          value, dot_tag, value       ) \
+    X("future?",                    is_future,                  bool,           value                       ) \
+    X("touch",                      touch,                      value,          value                       ) \
+    X("future-map",                 future_map,                 value,          value, value                ) \
+    X("fork-map",                   fork_map,                   value,          value, value, dot_tag, value) \
+    X("make-channel",               make_channel,               value,                                      ) \
+    X("channel?",                   is_channel,                 bool,           value                       ) \
+    X("channel-send!",              channel_send,               value,          value, value                ) \
+    X("channel-receive",            channel_receive,            value,          value                       ) \
+    X("make-weak-box",              make_weak_box,              value,          value                       ) \
+    X("weak-box?",                  is_weak_box,                bool,           value                       ) \
+    X("weak-box-value",             weak_box_value,             value,          value, dot_tag, value       ) \
+    X("make-ephemeron",             make_ephemeron,             value,          value, value                ) \
+    X("ephemeron?",                 is_ephemeron,               bool,           value                       ) \
+    X("ephemeron-key",              ephemeron_key,              value,          value                       ) \
+    X("ephemeron-datum",            ephemeron_datum,            value,          value                       ) \
+    X("ephemeron-broken?",          is_ephemeron_broken,        bool,           value                       ) \
+    X("make-weak-table",            make_weak_table,            value,                                      ) \
+    X("weak-table?",                is_weak_table,              bool,           value                       ) \
+    X("weak-table-ref",             weak_table_ref,             value,          value, value, dot_tag, value) \
+    X("weak-table-set!",            weak_table_set,             value,          value, value, value         ) \
+    X("weak-table-delete!",         weak_table_delete,          value,          value, value                ) \
+    X("weak-table-count",           weak_table_count,           int,            value                       ) \
+    X("make-guardian",              make_guardian,              value,                                      ) \
+    X("guardian?",                  is_guardian,                bool,           value                       ) \
+    X("guardian-register!",         guardian_register,          value,          value, value                ) \
+    X("guardian-collect",           guardian_collect,           value,          value                       ) \
+    X("register-finalizer!",        register_finalizer,         value,          value, value                ) \
+    X("gc-growth-factor",           gc_growth_factor,           value,          dot_tag, value              ) \
+    X("gc-threads",                 gc_threads,                 value,          dot_tag, value              ) \
+    X("gc-compaction",              gc_compaction,              value,          dot_tag, value              ) \
+    X("gc-compact",                 run_compaction,             int,                                        ) \
+    X("gc-concurrent-marking",      gc_concurrent_marking,      value,          dot_tag, value              ) \
     X("garbage-collect",            run_gc,                     int,                                        )
 
 #define DECLARE_C_FUNCTION(LISP_NAME, C_NAME, C_RETURN, ...) NOLDOR_EXPORT C_RETURN C_NAME (__VA_ARGS__);
@@ -368,6 +481,10 @@ NOLDOR_EXPORT value procedure_parameters(value);
 NOLDOR_EXPORT value procedure_body(value);
 NOLDOR_EXPORT value procedure_environment(value);
 
+NOLDOR_EXPORT value mk_case_lambda(value clauses, value environment);
+NOLDOR_EXPORT bool is_case_lambda(value);
+NOLDOR_EXPORT value case_lambda_select(value proc, value argl);
+
 NOLDOR_EXPORT value mk_primitive_procedure(std::string name, value (*fptr)(value));
 NOLDOR_EXPORT value apply_primitive_procedure(value proc, value argl);
 
@@ -377,6 +494,18 @@ NOLDOR_EXPORT std::vector<value> vector_get(value vec);
 NOLDOR_EXPORT value mk_string(std::string);
 NOLDOR_EXPORT std::string string_get(value);
 
+// interned for good, unlike the symbols string->symbol makes at runtime
+NOLDOR_EXPORT value symbol(std::string);
+
+enum error_kind {
+    error_kind_general,
+    error_kind_file,
+    error_kind_read
+};
+
+NOLDOR_EXPORT value mk_error_object(value message, value irritants, error_kind kind = error_kind_general);
+NOLDOR_EXPORT value error_object_from_exception(const noldor_exception &e);
+
 NOLDOR_EXPORT value mk_char(uint32_t c);
 NOLDOR_EXPORT uint32_t char_get(value);
 
@@ -31,6 +31,9 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <iostream>
 #include <vector>
 #include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -58,9 +61,13 @@ namespace noldor {
     X(argl) \
     X(continu) \
     X(unev) \
-    X(compapp)
+    X(compapp) \
+    X(mvals) \
+    X(handlers) \
+    X(winders) \
+    X(prompts)
 
-constexpr int N_REGISTERS = 8;
+constexpr int N_REGISTERS = 12;
 
 #define X(n) n,
 enum class reg { REGISTERS(X) };
@@ -134,9 +141,20 @@ struct looper {
 
 #define INTRUSIVE_LIST_LOOP(LIST, TYPE, MEMBERNAME) looper<TYPE, offsetof(TYPE, MEMBERNAME)>(LIST)
 
+NOLDOR_EXPORT uint64_t new_thread_id();
+
 struct NOLDOR_EXPORT thread_t {
     std::vector<uint64_t> stack;
-    std::array<uint64_t, N_REGISTERS> registers;
+    std::array<uint64_t, N_REGISTERS> registers {};
+
+    // Frames below `stack` that were frozen by a continuation capture: the
+    // bottom `segment_size` slots of the stack segment object `segment`.
+    // Segments are immutable and shared, frames are copied back on underflow.
+    uint64_t segment = 0;
+    size_t segment_size = 0;
+
+    const uint64_t id = new_thread_id();
+    thread_t *outer = nullptr;
 
     inline value getreg(reg r)
     {
@@ -150,6 +168,9 @@ struct NOLDOR_EXPORT thread_t {
 
     inline void restore(reg r)
     {
+        if (stack.empty())
+            underflow();
+
         registers[size_t(r)] = stack.back();
         stack.pop_back();
     }
@@ -158,6 +179,25 @@ struct NOLDOR_EXPORT thread_t {
     {
         registers[size_t(r)] = val;
     }
+
+    // stack indices below count frozen frames too
+    size_t depth() const;
+    uint64_t slot(size_t index) const;
+    void truncate(size_t depth);
+
+    void freeze();
+    void underflow();
+
+    inline void visit(gc_visit_fn_t visitor, void *data)
+    {
+        for (uint64_t &regval : registers)
+            visitor(reinterpret_cast<value *>(&regval), data);
+
+        for (uint64_t &stackval : stack)
+            visitor(reinterpret_cast<value *>(&stackval), data);
+
+        visitor(reinterpret_cast<value *>(&segment), data);
+    }
 };
 
 struct NOLDOR_EXPORT thread_scope_t : scope
@@ -168,45 +208,471 @@ struct NOLDOR_EXPORT thread_scope_t : scope
 
     void visit(gc_visit_fn_t visitor, void *data) override
     {
-        if (!thread)
-            return;
-
-        for (uint64_t &regval : thread->registers) {
-            value *v = reinterpret_cast<value *>(&regval);
-            visitor(v, data);
-        }
-
-        for (uint64_t &stackval : thread->stack) {
-            value *v = reinterpret_cast<value *>(&stackval);
-            visitor(v, data);
-        }
+        if (thread)
+            thread->visit(visitor, data);
     }
 };
 
 struct NOLDOR_EXPORT gc_header {
     metatype_t *metaobject = nullptr;
 
+    uint32_t alloc_size = 0;
+    uint8_t data_offset = 0;
+    bool large = false;                 // see large_object
+
+    char data[1];
+};
+
+// Objects too big for any size class, and the immortal objects of static
+// types, are malloc'ed one by one. Only these are kept on a list.
+struct NOLDOR_EXPORT large_object {
     list_t gc_objects;
     uint32_t gc_flags = 0;
+    uint32_t next_gc_flags = 0;         // of the concurrent marker
+    std::atomic<bool> remembered { false };
+    size_t n_bytes = 0;
 
-    uint8_t data_offset = 0;
-    uint32_t alloc_size = 0;
+    alignas(16) gc_header header;
 
-    char data[1];
+    static inline large_object *of(gc_header *header) noexcept
+    { return reinterpret_cast<large_object *>(reinterpret_cast<char *>(header) - offsetof(large_object, header)); }
 };
 
+// Small fixed-size objects live headerless in dedicated, size-aligned pages.
+// The page header identifies the type; allocation and mark state are kept in
+// side bitmaps, so a cell costs exactly its (rounded up) payload size.
+// Every other small object is a cell as well, in one of the object spaces:
+// those have no metaobject of their own, each cell starts with a gc_header.
+constexpr size_t CELL_PAGE_SIZE = 64 * 1024;
+constexpr size_t CELL_ALIGNMENT = 16;
+constexpr size_t CELL_BITMAP_WORDS = CELL_PAGE_SIZE / CELL_ALIGNMENT / 64;
+
+struct NOLDOR_EXPORT cell_page {
+    metatype_t *metaobject = nullptr;
+    struct cell_space *space = nullptr;
+
+    list_t gc_pages;
+
+    uint32_t cell_size = 0;
+    uint32_t n_cells = 0;
+    uint32_t n_bumped = 0;
+    uint32_t n_live = 0;
+    uint32_t n_unswept = 0;             // dead cells awaiting a lazy sweep
+
+    // a page is the allocation buffer of at most one OS thread at a time
+    bool claimed = false;
+    bool evacuating = false;            // by a compaction in progress
+    std::atomic<uint32_t> n_pinned { 0 };
+    void *free_list = nullptr;
+
+    uint64_t alloc_bits[CELL_BITMAP_WORDS] = {};
+    uint64_t mark_bits[CELL_BITMAP_WORDS] = {};
+    uint64_t next_mark_bits[CELL_BITMAP_WORDS] = {};   // of the concurrent marker
+
+    // old cells that may point at young ones, set by any thread's write barrier
+    std::atomic<uint64_t> remembered_bits[CELL_BITMAP_WORDS] = {};
+    std::atomic<bool> has_remembered { false };
+
+    char *cells = nullptr;
+
+    static inline cell_page *of(const void *cell) noexcept
+    { return reinterpret_cast<cell_page *>(reinterpret_cast<uintptr_t>(cell) & ~uintptr_t(CELL_PAGE_SIZE - 1)); }
+
+    inline uint32_t index_of(const void *cell) const noexcept
+    { return uint32_t((static_cast<const char *>(cell) - cells) / cell_size); }
+
+    inline void *cell_at(uint32_t index) const noexcept
+    { return cells + size_t(index) * cell_size; }
+
+    static inline bool test_bit(const uint64_t *bits, uint32_t i) noexcept
+    { return bits[i / 64] & (uint64_t(1) << (i % 64)); }
+
+    static inline void set_bit(uint64_t *bits, uint32_t i) noexcept
+    { bits[i / 64] |= (uint64_t(1) << (i % 64)); }
+
+    static inline void clear_bit(uint64_t *bits, uint32_t i) noexcept
+    { bits[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+    inline bool has_room() const noexcept
+    { return free_list || n_bumped < n_cells; }
+
+    inline void *take() noexcept
+    {
+        void *cell = free_list;
+
+        if (cell)
+            free_list = *static_cast<void **>(cell);
+        else if (n_bumped < n_cells)
+            cell = cell_at(n_bumped++);
+
+        return cell;
+    }
+};
+
+struct NOLDOR_EXPORT cell_space {
+    metatype_t *metaobject = nullptr;   // null for object spaces
+    uint32_t cell_size = 0;
+    uint32_t index = 0;                 // slot in each thread's allocation buffers
+
+    list_t gc_spaces;
+    list_t pages;
+
+    std::vector<cell_page *> available; // unclaimed pages with room, refilled by sweep
+    std::vector<cell_page *> unswept;   // unclaimed pages with dead cells
+};
+
+constexpr uint32_t OBJECT_SIZE_CLASSES[] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256,
+    320, 384, 448, 512, 640, 768, 896, 1024
+};
+
+constexpr size_t N_OBJECT_SIZE_CLASSES = sizeof(OBJECT_SIZE_CLASSES) / sizeof(OBJECT_SIZE_CLASSES[0]);
+
+// The collector is generational without moving anything: mark bits are
+// sticky, so every object that survived a collection is old and stays marked.
+// A minor collection traces from the roots and the remembered old objects
+// only, and sweeps what was allocated since and is now unreachable.
+// A collection is requested once GC_NURSERY_SIZE bytes have been allocated
+// since the last one. It is a full collection when the heap has grown past
+// full_threshold, the bytes surviving the last full collection times
+// growth_factor.
+// With concurrent marking turned on, a full collection instead starts a
+// background thread marking into a second set of mark bits while the
+// mutators run on. The write barrier then remembers every object stored
+// into, and the final pause retraces those from the roots before the new
+// mark bits replace the old ones.
+constexpr size_t GC_NURSERY_SIZE = 4 * 1024 * 1024;
+constexpr size_t GC_MIN_THRESHOLD = 8 * 1024 * 1024;
+
 struct gc_status_info {
-    size_t n_bytes_allocated = 0;
-    size_t n_objects_allocated = 0;
+    std::atomic<size_t> n_bytes_allocated { 0 };
+    std::atomic<size_t> n_objects_allocated { 0 };
+    std::atomic<size_t> threshold { GC_NURSERY_SIZE };
+    std::atomic<size_t> full_threshold { GC_MIN_THRESHOLD };
+    std::atomic<double> growth_factor { 2.0 };
+    std::atomic<unsigned> n_threads { 0 };  // marking and sweeping full collections, 0 for one per core
+};
+
+// Run once the collector finds obj dead, which brings obj back for it: a
+// native one right after the collection, otherwise a future applying proc.
+struct gc_finalizer {
+    value obj;
+    value proc;
+    void (*native)(value obj);
+};
+
+// An isolate is a heap and a global environment of its own. The OS threads
+// attached to one isolate share its heap and stop only each other to collect
+// it; isolates never point into each other's heaps and talk over channels.
+// Objects of static types (symbols, booleans, the empty list) are immortal
+// and belong to no heap, so every isolate can use them.
+struct NOLDOR_EXPORT isolate_t {
+    list_t thread_scopes;               // one list of scopes per thread, see scope::scope
+    list_t allocations;                 // large objects
+    list_t cell_spaces;
+    std::atomic<cell_space *> object_spaces[N_OBJECT_SIZE_CLASSES] {};
+    struct gc_status_info gc_status;
+    std::mutex heap_mutex;
+
+    list_t mutators;
+    std::mutex world_mutex;
+    std::condition_variable world_cv;
+    std::atomic<size_t> n_mutators { 0 };
+    std::atomic<bool> stop_requested { false };
+    std::atomic<bool> collect_requested { false };
+
+    std::atomic<bool> concurrent_marking { false };
+    std::atomic<bool> compaction { false };
+    std::atomic<bool> marking { false };
+    std::mutex marking_mutex;           // held by the marker while in a growable container
+    struct concurrent_marker *marker = nullptr;
+
+    std::vector<value> weak_objects;    // registered by gc_register_weak
+    std::unordered_set<uint64_t> weak_symbols;  // held, see symbol.cpp
+    std::vector<gc_finalizer> finalizers;       // waiting for their objects to die
+    std::vector<gc_finalizer> finalizing;       // to run after the collection
+
+    value global_environment { uint64_t(0) };    // set up by init_isolate
+    value interaction_environment { uint64_t(0) };
+    std::once_flag initialized;
+
+    struct work_pool *work_pool = nullptr;
+
+    isolate_t() = default;
+    ~isolate_t();
+
+    isolate_t(const isolate_t &) = delete;
+    isolate_t &operator=(const isolate_t &) = delete;
 };
 
 struct NOLDOR_EXPORT globals {
-    static list_t *scopes();
+    static isolate_t *isolate();        // of the calling OS thread
+    static void set_isolate(isolate_t *isolate);
+
+    static list_t *thread_scopes();
     static list_t *allocations();
+    static list_t *cell_spaces();
     static struct gc_status_info *gc_status_info();
-    static void register_allocation(gc_header *obj);
+    static void register_allocation(large_object *obj);
+
+    static std::mutex &heap_mutex();    // page lists, allocations and thread scope lists
+    static std::atomic<bool> &stop_requested();
+};
+
+NOLDOR_EXPORT void init_isolate();
+
+// Every OS thread that runs Scheme is a mutator. Collections and other
+// operations that need the heap to themselves stop the world: mutators
+// park at the safepoint polled by the interpreter, or are already parked
+// in a blocking region, where they hold no unrooted values. Allocation
+// never collects by itself; it requests a collection that the next
+// safepoint runs, when every live value sits in a register, on a thread
+// stack or in a scope.
+
+NOLDOR_EXPORT void attach_mutator();
+NOLDOR_EXPORT bool is_multithreaded();
+NOLDOR_EXPORT void safepoint_slow();
+NOLDOR_EXPORT void forget_other_mutators();     // in a forked child, under world_mutex
+
+NOLDOR_EXPORT void collect_if_requested();
+
+// with the world stopped and the heap locked
+NOLDOR_EXPORT void finish_concurrent_marking();
+
+// guards a container the concurrent marker may be walking while it changes shape
+struct marking_guard {
+    std::unique_lock<std::mutex> lock;
+
+    marking_guard()
+    {
+        isolate_t *isolate = globals::isolate();
+
+        if (isolate->marking.load(std::memory_order_relaxed))
+            lock = std::unique_lock<std::mutex>(isolate->marking_mutex);
+    }
 };
 
+// adds this thread's recent allocations to the isolate's totals
+NOLDOR_EXPORT void flush_allocation_counts();
+
+// out-of-line storage owned by heap objects, so it counts towards the gc threshold
+NOLDOR_EXPORT void gc_account_external(ptrdiff_t n_bytes);
+
+// to be called after storing a value into an existing object
+NOLDOR_EXPORT void gc_write_barrier(value obj);
+
+// Stores into a field the concurrent marker may be reading at the same time.
+// The release pairs with the marker's acquire in gc_mark, so that it sees a
+// newly allocated value initialized.
+inline void gc_store(value *field, value val)
+{
+    __atomic_store_n(reinterpret_cast<uint64_t *>(field), uint64_t(val), __ATOMIC_RELEASE);
+}
+
+// Compaction may move objects of movable types, and updates every reference
+// it can see: those in other objects and in scopes. A value kept elsewhere
+// across a safepoint or a blocking region, an object's data pointer, or an
+// object's address used as a key must be pinned instead, which keeps the
+// object (and the rest of its page) in place. Pins nest; they do not keep
+// the object alive.
+NOLDOR_EXPORT void gc_pin(value obj);
+NOLDOR_EXPORT void gc_unpin(value obj);
+
+struct pin_scope {
+    value obj;
+
+    explicit pin_scope(value v) : obj(v) { gc_pin(obj); }
+    ~pin_scope() { gc_unpin(obj); }
+
+    pin_scope(const pin_scope &) = delete;
+    pin_scope &operator=(const pin_scope &) = delete;
+};
+
+// Weak boxes, ephemerons, weak tables and guardians leave what they hold
+// weakly out of their gc_visit, and register with the collector, which goes
+// through them after marking: it visits the data kept by live keys with
+// weak_trace until nothing new gets marked, lets guardians bring back their
+// dead with weak_resurrect, traces again, and then has weak_clear drop
+// whatever is still unmarked. Compaction updates every reference they hold
+// with weak_visit. The collector sees all of them each time, so storing
+// into them needs no write barrier.
+typedef bool (*gc_live_fn_t)(value obj, void *data);
+
+NOLDOR_EXPORT void gc_register_weak(value obj);
+NOLDOR_EXPORT void gc_register_finalizer(value obj, void (*native)(value obj));
+NOLDOR_EXPORT void weak_trace(value obj, gc_live_fn_t is_live, void *live_data, gc_visit_fn_t visitor, void *data);
+NOLDOR_EXPORT void weak_resurrect(value obj, gc_live_fn_t is_live, void *live_data, gc_visit_fn_t visitor, void *data);
+NOLDOR_EXPORT void weak_clear(value obj, gc_live_fn_t is_live, void *live_data);
+NOLDOR_EXPORT void weak_visit(value obj, gc_visit_fn_t visitor, void *data);
+
+// symbols made by string->symbol are weak until interned any other way
+NOLDOR_EXPORT bool is_weak_symbol(value sym);
+// drops the isolate's hold on the weak symbols not in reached, or on all of them
+NOLDOR_EXPORT void release_weak_symbols(isolate_t *isolate, const std::unordered_set<uint64_t> *reached);
+
+// destroys and frees an object of a typeflags_static type
+NOLDOR_EXPORT void free_static(value obj);
+
+inline void safepoint()
+{
+    isolate_t *isolate = globals::isolate();
+
+    if (isolate->stop_requested.load(std::memory_order_relaxed) ||
+        isolate->collect_requested.load(std::memory_order_relaxed))
+        safepoint_slow();
+}
+
+struct NOLDOR_EXPORT blocking_region {
+    blocking_region();
+    ~blocking_region();
+
+    blocking_region(const blocking_region &) = delete;
+    blocking_region &operator=(const blocking_region &) = delete;
+
+private:
+    bool was_safe;
+};
+
+struct NOLDOR_EXPORT world_stop {
+    world_stop();
+    ~world_stop();
+
+    world_stop(const world_stop &) = delete;
+    world_stop &operator=(const world_stop &) = delete;
+};
+
+// procedures implemented by the interpreter itself, applied by jumping to label
+NOLDOR_EXPORT value mk_control_procedure(std::string name, uint64_t label);
+NOLDOR_EXPORT bool is_control_procedure(value val);
+NOLDOR_EXPORT uint64_t control_procedure_label(value proc);
+NOLDOR_EXPORT void register_control_procedures();
+
+NOLDOR_EXPORT value mk_continuation(thread_t &thread, value handlers, value winders, value prompts);
+NOLDOR_EXPORT bool is_continuation(value val);
+NOLDOR_EXPORT uint64_t continuation_owner(value k);
+NOLDOR_EXPORT value continuation_winders(value k);
+NOLDOR_EXPORT void continuation_reinstate(thread_t &thread, value k);
+
+// the stack slice above a reset prompt, captured by shift
+struct composable_continuation_t {
+    std::vector<uint64_t> slots;
+    uint64_t continu = 0;
+    value handlers = list();
+    value winders = list();
+    value outer_winders = list(); // winders in effect at the prompt
+    size_t base = 0;              // stack index the slice was taken from
+};
+
+NOLDOR_EXPORT value mk_composable_continuation(composable_continuation_t data);
+NOLDOR_EXPORT bool is_composable_continuation(value val);
+NOLDOR_EXPORT composable_continuation_t *composable_continuation_data(value k);
+
+// carries a continuation invocation out of a nested interpreter run to the
+// run that captured it
+struct NOLDOR_EXPORT continuation_jump {
+    uint64_t owner;
+    value continuation;
+    value arguments;
+};
+
+// Green threads: each has its own registers and stack and is switched by the
+// scheduler at yield, join and blocking reads. Only the outermost interpreter
+// run on an OS thread switches; nested runs keep the current thread pinned.
+
+enum green_thread_status {
+    green_thread_new,
+    green_thread_runnable,
+    green_thread_blocked,
+    green_thread_terminated
+};
+
+struct green_thread_t {
+    std::unique_ptr<thread_t> owned;
+    thread_t *thread = nullptr;     // owned, or the stack of an outermost run
+    value thunk = list();
+    value name = list();
+    value result = list();          // value, or raised object if failed
+    value joiners = list();
+    value joining = list();         // thread this one waits for in thread-join!
+    value connecting = list();      // socket of a tcp-connect that parked, see tcp_connect
+    size_t connecting_address = 0;  // index of the address it is connecting to
+    bool failed = false;
+    green_thread_status status = green_thread_new;
+    uint64_t resume = 0;            // label to continue at when scheduled
+    uint64_t wait_ticket = 0;       // bumped whenever the thread stops waiting
+};
+
+NOLDOR_EXPORT value mk_primordial_thread(thread_t &thread);
+NOLDOR_EXPORT green_thread_t *green_thread_data(value t);
+
+// thrown by a blocking read to park the current green thread on fd
+struct NOLDOR_EXPORT green_thread_park {
+    int fd;
+    short events;
+};
+
+NOLDOR_EXPORT bool scheduler_can_park();
+NOLDOR_EXPORT void scheduler_set_can_park(bool can_park);
+NOLDOR_EXPORT void scheduler_set_current(value t);
+NOLDOR_EXPORT bool scheduler_has_other_threads();
+NOLDOR_EXPORT void scheduler_make_runnable(value t, uint64_t resume);
+NOLDOR_EXPORT void scheduler_block(value t, uint64_t resume);
+NOLDOR_EXPORT void scheduler_wait_fd(value t, int fd, short events);
+NOLDOR_EXPORT void scheduler_wait_timer(value t, double seconds);
+NOLDOR_EXPORT void scheduler_wake(value t, uint64_t ticket);
+NOLDOR_EXPORT void scheduler_wait_join(value t, value target, uint64_t resume);
+NOLDOR_EXPORT void scheduler_terminate(value t, value result, bool failed);
+NOLDOR_EXPORT void scheduler_forget(value t);
+NOLDOR_EXPORT value scheduler_next();
+NOLDOR_EXPORT void scheduler_wait_readable(int fd);
+NOLDOR_EXPORT void scheduler_wait_writable(int fd);
+
+// epoll (poll outside Linux) plus a timer wheel; wakes waiters by ticket
+NOLDOR_EXPORT void event_loop_watch(int fd, short events, value thread, uint64_t ticket);
+NOLDOR_EXPORT void event_loop_timer(double seconds, value thread, uint64_t ticket);
+NOLDOR_EXPORT void event_loop_run(bool block);
+
+NOLDOR_EXPORT int port_fd(value port);
+
+// the isolate's worker threads, started on first use; items are futures
+NOLDOR_EXPORT void work_pool_submit(value future);
+NOLDOR_EXPORT size_t work_pool_size();
+NOLDOR_EXPORT bool work_pool_help();
+NOLDOR_EXPORT void work_pool_shutdown();
+NOLDOR_EXPORT void future_run(value future);
+
+// A datum copied out of one isolate's heap so that another can rebuild it:
+// the tree flattened in prefix order, a list as its elements and then its
+// tail. Immediates and static objects are carried as they are, but for
+// weak symbols, which go by name.
+struct channel_state;
+
+enum message_kind {
+    message_immediate,
+    message_char,
+    message_string,
+    message_list,
+    message_vector,
+    message_channel,
+    message_symbol
+};
+
+struct message_node {
+    message_kind kind = message_immediate;
+    value datum { uint64_t(0) };
+    uint32_t length = 0;            // element count, or the character
+    std::string text;
+    std::shared_ptr<channel_state> channel;
+};
+
+typedef std::vector<message_node> message_t;
+
+NOLDOR_EXPORT message_t message_from(value datum);
+NOLDOR_EXPORT value message_value(const message_t &message);
+
+NOLDOR_EXPORT value values_marker();
+NOLDOR_EXPORT bool is_values_marker(value val);
+
 union NOLDOR_EXPORT flipper_t {
     uint64_t u64;
     double dd;
@@ -219,7 +685,10 @@ class NOLDOR_EXPORT magic {
         max_double = 0xfff8000000000000,
         int32_tag  = 0xfff9000000000000,
         ptr_tag    = 0xfffa000000000000,
-        tag_mask   = 0xffff000000000000
+        cell_tag   = 0xfffb000000000000,
+        tag_mask   = 0xffff000000000000,
+        boxed_mask = 0xfffe000000000000, // ptr_tag and cell_tag alike
+        type_mask  = 0x000000000000000f  // type_tag in the low pointer bits
     };
 
 public:
@@ -232,6 +701,12 @@ public:
     static inline bool is_pointer(uint64_t u) noexcept
     { return (u & tag_mask) == ptr_tag; }
 
+    static inline bool is_cell(uint64_t u) noexcept
+    { return (u & tag_mask) == cell_tag; }
+
+    static inline bool has_type_tag(uint64_t u, type_tag tag) noexcept
+    { return (u & (boxed_mask | type_mask)) == (ptr_tag | tag); }
+
     static inline double get_double(uint64_t u)
     { check_type(is_double, u, "magic; double expected"); flipper_t flipper; flipper.u64 = u; return flipper.dd; }
 
@@ -239,7 +714,10 @@ public:
     { check_type(is_int, u, "magic: int expected"); return static_cast<int32_t>(u & ~int32_tag); }
 
     static inline void* get_pointer(uint64_t u)
-    { check_type(is_pointer, u, "magic: pointer expected"); return reinterpret_cast<void *>(u & ~ptr_tag); }
+    { check_type(is_pointer, u, "magic: pointer expected"); return reinterpret_cast<void *>(u & ~(ptr_tag | type_mask)); }
+
+    static inline void* get_cell(uint64_t u)
+    { check_type(is_cell, u, "magic: cell expected"); return reinterpret_cast<void *>(u & ~(cell_tag | type_mask)); }
 
     static inline uint64_t from_double(double d) noexcept
     { flipper_t flipper; flipper.dd = d; return flipper.u64; }
@@ -247,8 +725,11 @@ public:
     static inline uint64_t from_int32(int32_t i) noexcept
     { return (uint64_t(i) & 0xffffffff) | int32_tag; }
 
-    static inline uint64_t from_pointer(const void *d) noexcept
-    { return reinterpret_cast<uint64_t>(d) | ptr_tag; }
+    static inline uint64_t from_pointer(const void *d, type_tag tag = type_tag_none) noexcept
+    { return reinterpret_cast<uint64_t>(d) | ptr_tag | tag; }
+
+    static inline uint64_t from_cell(const void *d, type_tag tag = type_tag_none) noexcept
+    { return reinterpret_cast<uint64_t>(d) | cell_tag | tag; }
 };
 
 } // namespace noldor
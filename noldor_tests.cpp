@@ -24,6 +24,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include "noldor.h"
+#include "noldor_impl.h"
+
+#include <cstdlib>
+#include <unistd.h>
 
 using namespace noldor;
 
@@ -35,5 +39,312 @@ int main(int argc, char **argv)
     basic_scope sc {&env};
     run_gc();
 
+    value pairs = list();
+    basic_scope pairs_scope {&pairs};
+
+    for (int32_t i = 0; i < 10000; ++i)
+        pairs = cons(mk_int(i), pairs);
+
+    run_gc();
+
+    if (length(pairs) != 10000 || to_int(car(pairs)) != 9999)
+        return 1;
+
+    auto eval_string = [&env] (std::string text) { return eval(read(open_input_string(text)), env); };
+
+    if (to_int(eval_string("(let-values (((a b) (values 1 2)) ((c) 3)) (+ a b c))")) != 6)
+        return 1;
+
+    auto refused = [&eval_string] (std::string text) {
+        return !is_false(eval_string("(eq? 'refused (guard (e ((error-object? e) 'refused)) " + text + "))"));
+    };
+
+    eval_string("(define mv-target 0)");
+    if (!refused("(list (values 1 2))") || !refused("(if (values) 1 2)") || !refused("(set! mv-target (values 1 2))")
+            || !refused("(begin (define mv-defined (values 1 2)) mv-defined)") || to_int(eval_string("mv-target")) != 0)
+        return 1;
+
+    if (to_int(eval_string("(car (list (values 7)))")) != 7
+            || to_int(eval_string("(length (call-with-values (lambda () (values 1 2)) list))")) != 2)
+        return 1;
+
+    eval_string("(define case-arity (case-lambda ((x) 1) ((x y) 2) ((x . rest) (+ 10 (length rest)))))");
+    if (to_int(eval_string("(case-arity 'a)")) != 1 || to_int(eval_string("(case-arity 'a 'b)")) != 2
+            || to_int(eval_string("(case-arity 'a 'b 'c)")) != 12 || to_int(eval_string("(case-arity 1 2 3 4 5 6 7 8 9 10)")) != 19
+            || !refused("(case-arity)"))
+        return 1;
+
+    if (to_int(eval_string("((case-lambda ((x . rest) 1) ((x y) 2)) 'a 'b)")) != 1)
+        return 1;
+
+    if (to_int(eval_string("(guard (e ((error-object? e) (length (error-object-irritants e)))) (error \"x\" 1 2))")) != 2)
+        return 1;
+
+    if (to_int(eval_string("(guard (e (#t (length (error-object-irritants e)))) (+ 1 'a))")) != 2)
+        return 1;
+
+    if (to_int(eval_string("(+ 1 (call/cc (lambda (k) (dynamic-wind (lambda () 0) (lambda () (k 41)) (lambda () 0)))))")) != 42)
+        return 1;
+
+    if (to_int(eval_string("(reset (+ 1 (shift k (k (k 10)))))")) != 12)
+        return 1;
+
+    if (to_int(eval_string("(thread-join! (thread-start! (make-thread (lambda () (thread-yield!) 7))))")) != 7)
+        return 1;
+
+    if (to_int(eval_string("(thread-join! (thread-start! (make-thread (lambda () (thread-sleep! 0.01) 8))))")) != 8)
+        return 1;
+
+    if (!is_null(eval_string("(wait-ports (list) 0)")))
+        return 1;
+
+    eval_string("(define tcp-listener (make-tcp-listener 0 \"127.0.0.1\"))");
+    eval_string("(define tcp-client (tcp-connect \"127.0.0.1\" (listener-port tcp-listener)))");
+    eval_string("(define tcp-server (accept tcp-listener))");
+    if (!is_socket_port(eval_string("tcp-client")) || !is_socket_port(eval_string("tcp-server")))
+        return 1;
+
+    eval_string("(write (list 5) tcp-client)");
+    eval_string("(flush-output-port tcp-client)");
+    if (to_int(eval_string("(car (read tcp-server))")) != 5)
+        return 1;
+
+    char unix_dir[] = "/tmp/noldor-test-XXXXXX";
+    if (!mkdtemp(unix_dir))
+        return 1;
+
+    std::string unix_path = std::string(unix_dir) + "/socket";
+    eval_string("(define unix-listener (make-unix-listener \"" + unix_path + "\"))");
+    eval_string("(define unix-client (unix-connect \"" + unix_path + "\"))");
+    eval_string("(define unix-server (accept unix-listener))");
+    eval_string("(write (list 7) unix-client)");
+    eval_string("(flush-output-port unix-client)");
+    value unix_result = eval_string("(car (read unix-server))");
+    eval_string("(close-port unix-client)");
+    eval_string("(close-port unix-server)");
+    eval_string("(close-port unix-listener)");
+    if (to_int(unix_result) != 7 || rmdir(unix_dir) != 0)
+        return 1;
+
+    eval_string("(define flood-listener (make-tcp-listener 0 \"127.0.0.1\"))");
+    eval_string("(define flood-sender (tcp-connect \"127.0.0.1\" (listener-port flood-listener)))");
+    eval_string("(define flood-receiver (accept flood-listener))");
+    eval_string("(define flood-chunk (make-vector 5000 0))");
+    eval_string("(define (flood-write) (write flood-chunk flood-sender) (flood-write))");
+    eval_string("(define (flood)"
+                "  (define writer (thread-start! (make-thread (lambda () (flood-write) 'sent))))"
+                "  (thread-sleep! 0.05)"
+                "  (close-port flood-receiver)"
+                "  (guard (e (#t 'failed)) (thread-join! writer)))");
+    if (is_false(eval_string("(eq? (flood) 'failed)")))
+        return 1;
+
+    if (to_int(eval_string("(os-thread-join! (make-os-thread (lambda () (garbage-collect) 9)))")) != 9)
+        return 1;
+
+    eval_string("(define half-listener (make-tcp-listener 0 \"127.0.0.1\"))");
+    eval_string("(define half-sender (tcp-connect \"127.0.0.1\" (listener-port half-listener)))");
+    eval_string("(define half-receiver (accept half-listener))");
+    eval_string("(display (string->symbol \"(1 2\") half-sender)");
+    eval_string("(flush-output-port half-sender)");
+    eval_string("(define half-ready (make-channel))");
+    eval_string("(define half-reader (make-os-thread (lambda ()"
+                "  (channel-send! half-ready (peek-char half-receiver))"
+                "  (apply + (read half-receiver)))))");
+    eval_string("(channel-receive half-ready)");
+    eval_string("(garbage-collect)");
+    eval_string("(display (string->symbol \" 3)\") half-sender)");
+    eval_string("(flush-output-port half-sender)");
+    if (to_int(eval_string("(os-thread-join! half-reader)")) != 6)
+        return 1;
+
+    eval_string("(define isolate-channel (make-channel))");
+    eval_string("(define child-isolate (make-isolate '(lambda (c) (channel-send! c (list 1 \"x\")) 2) isolate-channel))");
+    if (to_int(eval_string("(isolate-join! child-isolate)")) != 2)
+        return 1;
+
+    if (is_false(eval_string("(equal? (channel-receive isolate-channel) (list 1 \"x\"))")))
+        return 1;
+
+    eval_string("(define circular (list 1 2))");
+    eval_string("(set-cdr! (cdr circular) circular)");
+    if (is_false(eval_string("(guard (e ((error-object? e) #t)) (channel-send! isolate-channel circular) #f)")))
+        return 1;
+
+    eval_string("(define (two-receivers)"
+                "  (define ready (make-channel))"
+                "  (define done (make-channel))"
+                "  (define (receiver) (channel-send! ready 'parking) (channel-send! done (channel-receive isolate-channel)))"
+                "  (define a (thread-start! (make-thread receiver)))"
+                "  (define b (thread-start! (make-thread receiver)))"
+                "  (channel-receive ready)"
+                "  (channel-receive ready)"
+                "  (define sum (+ (begin (channel-send! isolate-channel 1) (channel-receive done))"
+                "                 (begin (channel-send! isolate-channel 2) (channel-receive done))))"
+                "  (thread-join! a)"
+                "  (thread-join! b)"
+                "  sum)");
+    if (to_int(eval_string("(two-receivers)")) != 3)
+        return 1;
+
+    eval_string("(define (channel-flood n) (if (= n 0) 'sent (begin (channel-send! isolate-channel n) (channel-flood (- n 1)))))");
+    eval_string("(define (channel-drain n acc) (if (= n 0) acc (begin (channel-receive isolate-channel) (channel-drain (- n 1) (+ acc 1)))))");
+    eval_string("(define (fill-channel)"
+                "  (define sender (thread-start! (make-thread (lambda () (channel-flood 70000)))))"
+                "  (define receiver (thread-start! (make-thread (lambda () (channel-drain 70000 0)))))"
+                "  (thread-join! sender)"
+                "  (thread-join! receiver))");
+    if (to_int(eval_string("(fill-channel)")) != 70000)
+        return 1;
+
+    if (to_int(eval_string("(touch (future (apply + (future-map (lambda (x) (* x x)) (list 1 2 3)))))")) != 14)
+        return 1;
+
+    if (to_int(eval_string("(vector-reduce/par + 0 (vector-map/par (lambda (x) (* x x)) (make-vector 1000 2)))")) != 4000)
+        return 1;
+
+    if (to_int(eval_string("(apply + (fork-map (lambda (x) (* x x)) (list 1 2 3) 2))")) != 14)
+        return 1;
+
+    eval_string("(define (churn n) (if (= n 0) 0 (begin (make-vector 1000 0) (churn (- n 1)))))");
+    eval_string("(garbage-collect)");
+    if (to_int(eval_string("(churn 20000)")) != 0)
+        return 1;
+    // the churn allocates some 160MB; what is left for an explicit
+    // collection to free must be no more than a few nurseries' worth
+    if (to_int(eval_string("(garbage-collect)")) > 16 * 1024 * 1024)
+        return 1;
+
+    eval_string("(define kept (list (make-vector 2 7) \"kept\" (lambda (x) x)))");
+    eval_string("(churn 20000)");
+    eval_string("(garbage-collect)");
+    if (to_int(eval_string("((caddr kept) (vector-ref (car kept) 1))")) != 7)
+        return 1;
+
+    eval_string("(define old (make-vector 1 0))");
+    eval_string("(garbage-collect)");
+    eval_string("(vector-set! old 0 (list 1 2 3))");
+    eval_string("(define (churn-pairs n) (if (= n 0) 0 (begin (make-vector 100 0) (list 4 5 6 7) (churn-pairs (- n 1)))))");
+    eval_string("(churn-pairs 20000)");
+    if (to_int(eval_string("(apply + (vector-ref old 0))")) != 6)
+        return 1;
+
+    eval_string("(define (iota-list n acc) (if (= n 0) acc (iota-list (- n 1) (cons n acc))))");
+    eval_string("(define long-list (iota-list 300000 '()))");
+    eval_string("(garbage-collect)");
+    if (to_int(eval_string("(car (cdr long-list))")) != 2)
+        return 1;
+
+    eval_string("(set! long-list '())");
+    if (to_int(eval_string("(garbage-collect)")) <= 0)
+        return 1;
+
+    eval_string("(gc-concurrent-marking #t)");
+    eval_string("(vector-set! old 0 '())");
+    eval_string("(define (grow-into n) (if (= n 0) 0 (begin (vector-set! old 0 (cons (make-vector 100 n) (vector-ref old 0))) (grow-into (- n 1)))))");
+    eval_string("(grow-into 30000)");
+    if (to_int(eval_string("(length (vector-ref old 0))")) != 30000 || to_int(eval_string("(vector-ref (car (vector-ref old 0)) 99)")) != 1)
+        return 1;
+
+    eval_string("(gc-concurrent-marking #f)");
+
+    eval_string("(gc-threads 4)");
+    eval_string("(define wide (make-vector 64 0))");
+    eval_string("(define (fill-wide i) (if (= i 64) 0 (begin (vector-set! wide i (iota-list 5000 '())) (fill-wide (+ i 1)))))");
+    eval_string("(fill-wide 0)");
+    eval_string("(garbage-collect)");
+    if (to_int(eval_string("(length (vector-ref wide 63))")) != 5000 || to_int(eval_string("(car (vector-ref wide 0))")) != 1)
+        return 1;
+
+    eval_string("(vector-set! old 0 '())");
+    if (to_int(eval_string("(garbage-collect)")) <= 0 || to_int(eval_string("(length (vector-ref wide 0))")) != 5000)
+        return 1;
+
+    eval_string("(gc-threads 0)");
+
+    eval_string("(define kept '())");
+    eval_string("(define dropped '())");
+    eval_string("(define (interleave n) (if (= n 0) 0 (begin (set! kept (cons n kept)) (set! dropped (cons n (cons n (cons n dropped)))) (interleave (- n 1)))))");
+    eval_string("(interleave 100000)");
+    eval_string("(set! dropped '())");
+    if (to_int(eval_string("(gc-compact)")) <= 0)
+        return 1;
+
+    if (to_int(eval_string("(length kept)")) != 100000 || to_int(eval_string("(car (cdr kept))")) != 2
+            || to_int(eval_string("(length (vector-ref wide 7))")) != 5000)
+        return 1;
+
+    // compaction empties the sparse pages but must leave a pinned pair's page be
+    value sparse = list();
+    value sparse_dropped = list();
+    basic_scope sparse_scope {&sparse, &sparse_dropped};
+
+    for (int32_t i = 0; i < 100000; ++i) {
+        sparse = cons(mk_int(i), sparse);
+        sparse_dropped = cons(mk_int(i), cons(mk_int(i), cons(mk_int(i), sparse_dropped)));
+    }
+
+    sparse_dropped = list();
+
+    value sparse_middle = sparse;
+    basic_scope middle_scope {&sparse_middle};
+    std::vector<uint64_t> sparse_before;
+
+    for (value p = sparse; !is_null(p); p = cdr(p)) {
+        if (sparse_before.size() == 50000)
+            sparse_middle = p;
+        sparse_before.push_back(p);
+    }
+
+    {
+        pin_scope pin(sparse_middle);
+
+        if (run_compaction() <= 0 || uint64_t(sparse_middle) != sparse_before[50000] || to_int(car(sparse_middle)) != 49999)
+            return 1;
+    }
+
+    size_t sparse_moved = 0;
+    size_t sparse_index = 0;
+    for (value p = sparse; !is_null(p); p = cdr(p))
+        sparse_moved += uint64_t(p) != sparse_before[sparse_index++];
+    if (sparse_moved == 0 || sparse_index != 100000)
+        return 1;
+
+    eval_string("(define weak-kept (list 1 2))");
+    eval_string("(define weak-entries (make-weak-table))");
+    eval_string("(weak-table-set! weak-entries weak-kept (make-ephemeron weak-kept 'kept))");
+    eval_string("(weak-table-set! weak-entries (list 3) 'dropped)");
+    eval_string("(define weak-list (make-weak-box (list 4)))");
+    eval_string("(define weak-symbol (make-weak-box (string->symbol \"weak-test-symbol\")))");
+    eval_string("(garbage-collect)");
+    if (to_int(eval_string("(weak-table-count weak-entries)")) != 1 || !is_false(eval_string("(weak-box-value weak-list)"))
+            || !is_false(eval_string("(weak-box-value weak-symbol)"))
+            || !is_false(eval_string("(ephemeron-broken? (weak-table-ref weak-entries weak-kept))")))
+        return 1;
+
+    eval_string("(define guardian (make-guardian))");
+    eval_string("(guardian-register! guardian (list 'guarded))");
+    eval_string("(define finalized-channel (make-channel))");
+    eval_string("(register-finalizer! (list 5) (lambda (obj) (channel-send! finalized-channel (car obj))))");
+    eval_string("(garbage-collect)");
+    eval_string("(define finalized #f)");
+    eval_string("(thread-start! (make-thread (lambda () (set! finalized (channel-receive finalized-channel)))))");
+    eval_string("(define (wait-finalized deadline)"
+                "  (if finalized finalized"
+                "      (if (> (current-second) deadline) #f"
+                "          (begin (thread-sleep! 0.01) (wait-finalized deadline)))))");
+    if (!is_pair(eval_string("(guardian-collect guardian)")) || !is_false(eval_string("(guardian-collect guardian)"))
+            || !is_int(eval_string("(wait-finalized (+ (current-second) 10))")) || to_int(eval_string("finalized")) != 5)
+        return 1;
+
+    eval_string("(define dropped-listener (make-tcp-listener 0 \"127.0.0.1\"))");
+    eval_string("(define dropped-port (tcp-connect \"127.0.0.1\" (listener-port dropped-listener)))");
+    eval_string("(define dropped-peer (accept dropped-listener))");
+    eval_string("(write (list 6) dropped-port)");
+    eval_string("(set! dropped-port #f)");
+    eval_string("(garbage-collect)");
+    if (to_int(eval_string("(car (read dropped-peer))")) != 6)
+        return 1;
+
     return 0;
 }
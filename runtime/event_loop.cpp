@@ -0,0 +1,332 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+# include <sys/epoll.h>
+#endif
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace noldor {
+
+// Readiness of the fds parked green threads wait on comes from epoll on
+// Linux and poll elsewhere; sleeping threads sit in a timer wheel. Both only
+// hold wake-up tickets, so a thread parked on several events is woken by the
+// first one to fire and its other registrations go stale.
+
+struct event_waiter {
+    value thread;
+    uint64_t ticket;
+    short events;
+};
+
+struct timer_entry {
+    uint64_t tick;
+    value thread;
+    uint64_t ticket;
+};
+
+static const size_t TIMER_WHEEL_SLOTS = 256;
+static const uint64_t TIMER_TICK_MS = 4;
+
+static uint64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000 + uint64_t(ts.tv_nsec) / 1000000;
+}
+
+struct event_loop_t : scope {
+    std::unordered_map<int, std::vector<event_waiter>> fds;
+    std::vector<event_waiter> ready_now; // fds epoll cannot watch, e.g. regular files
+
+    std::vector<timer_entry> wheel[TIMER_WHEEL_SLOTS];
+    uint64_t tick = now_ms() / TIMER_TICK_MS;
+    size_t n_timers = 0;
+
+#if defined(__linux__)
+    int epfd = -1;
+#endif
+
+    ~event_loop_t()
+    {
+#if defined(__linux__)
+        if (epfd != -1)
+            close(epfd);
+#endif
+    }
+
+    void visit(gc_visit_fn_t visitor, void *data) override
+    {
+        for (auto &fd : fds) {
+            for (event_waiter &w : fd.second)
+                visitor(&w.thread, data);
+        }
+
+        for (event_waiter &w : ready_now)
+            visitor(&w.thread, data);
+
+        for (auto &slot : wheel) {
+            for (timer_entry &t : slot)
+                visitor(&t.thread, data);
+        }
+    }
+};
+
+static event_loop_t &event_loop()
+{
+    static thread_local event_loop_t loop;
+    return loop;
+}
+
+static short waiter_events(const std::vector<event_waiter> &waiters)
+{
+    short events = 0;
+    for (const event_waiter &w : waiters)
+        events |= w.events;
+
+    return events;
+}
+
+#if defined(__linux__)
+
+static uint32_t epoll_events(short events)
+{
+    return (events & POLLIN ? uint32_t(EPOLLIN) : 0u) | (events & POLLOUT ? uint32_t(EPOLLOUT) : 0u);
+}
+
+static short poll_events(uint32_t events)
+{
+    return short((events & EPOLLIN ? POLLIN : 0) | (events & EPOLLOUT ? POLLOUT : 0)
+               | (events & EPOLLERR ? POLLERR : 0) | (events & EPOLLHUP ? POLLHUP : 0));
+}
+
+// false if fd cannot be watched and is always ready
+static bool update_epoll(event_loop_t &loop, int fd, short events)
+{
+    if (loop.epfd == -1) {
+        loop.epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop.epfd == -1)
+            throw runtime_error(std::string("event loop: epoll_create1: ") + strerror(errno));
+    }
+
+    if (events == 0) {
+        epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, nullptr);
+        return true;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = epoll_events(events);
+    ev.data.fd = fd;
+
+    // a closed fd drops out of the epoll set on its own, so MOD may need ADD
+    if (epoll_ctl(loop.epfd, EPOLL_CTL_MOD, fd, &ev) == 0)
+        return true;
+
+    if (errno == ENOENT && epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fd, &ev) == 0)
+        return true;
+
+    if (errno == EPERM)
+        return false;
+
+    throw runtime_error(std::string("event loop: epoll_ctl: ") + strerror(errno));
+}
+
+#endif
+
+static bool is_stale(const event_waiter &w)
+{
+    auto data = green_thread_data(w.thread);
+    return data->status != green_thread_blocked || data->wait_ticket != w.ticket;
+}
+
+void event_loop_watch(int fd, short events, value thread, uint64_t ticket)
+{
+    auto &loop = event_loop();
+    auto &waiters = loop.fds[fd];
+
+    waiters.erase(std::remove_if(waiters.begin(), waiters.end(), is_stale), waiters.end());
+    waiters.push_back({ thread, ticket, events });
+
+#if defined(__linux__)
+    if (!update_epoll(loop, fd, waiter_events(waiters))) {
+        waiters.pop_back();
+        loop.ready_now.push_back({ thread, ticket, events });
+    }
+
+    if (waiters.empty())
+        loop.fds.erase(fd);
+#endif
+}
+
+void event_loop_timer(double seconds, value thread, uint64_t ticket)
+{
+    auto &loop = event_loop();
+
+    uint64_t deadline = now_ms() + uint64_t(std::max(seconds, 0.0) * 1000.0);
+    uint64_t target = std::max((deadline + TIMER_TICK_MS - 1) / TIMER_TICK_MS, loop.tick + 1);
+
+    loop.wheel[target % TIMER_WHEEL_SLOTS].push_back({ target, thread, ticket });
+    loop.n_timers++;
+}
+
+// milliseconds until the next timer may be due, -1 without timers
+static int timer_timeout(event_loop_t &loop)
+{
+    if (loop.n_timers == 0)
+        return -1;
+
+    for (uint64_t t = loop.tick + 1; t <= loop.tick + TIMER_WHEEL_SLOTS; ++t) {
+        for (const timer_entry &e : loop.wheel[t % TIMER_WHEEL_SLOTS]) {
+            if (e.tick <= t) {
+                uint64_t due = t * TIMER_TICK_MS, now = now_ms();
+                return due > now ? int(due - now) : 0;
+            }
+        }
+    }
+
+    return int(TIMER_WHEEL_SLOTS * TIMER_TICK_MS);
+}
+
+static void advance_timers(event_loop_t &loop)
+{
+    uint64_t target = now_ms() / TIMER_TICK_MS;
+
+    // a wait longer than a full turn only needs one pass over the wheel
+    if (target > loop.tick + TIMER_WHEEL_SLOTS)
+        loop.tick = target - TIMER_WHEEL_SLOTS;
+
+    while (loop.tick < target && loop.n_timers > 0) {
+        ++loop.tick;
+        auto &slot = loop.wheel[loop.tick % TIMER_WHEEL_SLOTS];
+
+        std::vector<timer_entry> kept;
+        for (const timer_entry &e : slot) {
+            if (e.tick <= target) {
+                loop.n_timers--;
+                scheduler_wake(e.thread, e.ticket);
+            } else {
+                kept.push_back(e);
+            }
+        }
+
+        slot.swap(kept);
+    }
+
+    loop.tick = target;
+}
+
+static void wake_fd(event_loop_t &loop, int fd, short revents)
+{
+    auto it = loop.fds.find(fd);
+    if (it == loop.fds.end())
+        return;
+
+    std::vector<event_waiter> kept;
+    for (const event_waiter &w : it->second) {
+        if (revents & (w.events | POLLERR | POLLHUP))
+            scheduler_wake(w.thread, w.ticket);
+        else if (!is_stale(w))
+            kept.push_back(w);
+    }
+
+    it->second.swap(kept);
+
+#if defined(__linux__)
+    update_epoll(loop, fd, waiter_events(it->second));
+#endif
+
+    if (it->second.empty())
+        loop.fds.erase(it);
+}
+
+void event_loop_run(bool block)
+{
+    auto &loop = event_loop();
+
+    if (!loop.ready_now.empty()) {
+        std::vector<event_waiter> ready;
+        ready.swap(loop.ready_now);
+
+        for (const event_waiter &w : ready)
+            scheduler_wake(w.thread, w.ticket);
+
+        block = false;
+    }
+
+    int timeout = block ? timer_timeout(loop) : 0;
+
+#if defined(__linux__)
+    if (loop.epfd != -1 && !loop.fds.empty()) {
+        struct epoll_event events[64];
+
+        int n;
+        {
+            blocking_region blocking;
+            EINTR_SAFE(n, epoll_wait, loop.epfd, events, 64, timeout);
+        }
+
+        if (n == -1)
+            throw runtime_error(std::string("event loop: epoll_wait: ") + strerror(errno));
+
+        for (int i = 0; i < n; ++i)
+            wake_fd(loop, events[i].data.fd, poll_events(events[i].events));
+    } else if (timeout > 0) {
+        struct timespec ts = { timeout / 1000, long(timeout % 1000) * 1000000 };
+        blocking_region blocking;
+        nanosleep(&ts, nullptr);
+    }
+#else
+    std::vector<struct pollfd> pfds;
+    for (auto &fd : loop.fds)
+        pfds.push_back({ fd.first, waiter_events(fd.second), 0 });
+
+    int n;
+    {
+        blocking_region blocking;
+        EINTR_SAFE(n, ::poll, pfds.data(), nfds_t(pfds.size()), timeout);
+    }
+
+    if (n == -1)
+        throw runtime_error(std::string("event loop: poll: ") + strerror(errno));
+
+    for (const struct pollfd &pfd : pfds) {
+        if (pfd.revents)
+            wake_fd(loop, pfd.fd, pfd.revents);
+    }
+#endif
+
+    advance_timers(loop);
+}
+
+}
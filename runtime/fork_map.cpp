@@ -0,0 +1,388 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <poll.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+namespace noldor {
+
+// fork-map forks one worker process per slice of its input. The workers
+// inherit the heap copy-on-write, map their slice and stream the results
+// back over a pipe in a compact binary encoding; the parent decodes them in
+// order once every worker is done.
+
+enum wire_tag : uint8_t {
+    wire_int,
+    wire_double,
+    wire_true,
+    wire_false,
+    wire_null,
+    wire_eof,
+    wire_char,
+    wire_string,
+    wire_symbol,
+    wire_list,      // count, elements, tail
+    wire_vector,    // count, elements
+    wire_error      // message, the worker gives up
+};
+
+template <class T>
+static void put(std::string &out, T data)
+{
+    out.append(reinterpret_cast<const char *>(&data), sizeof(data));
+}
+
+static void put_text(std::string &out, wire_tag tag, const std::string &text)
+{
+    put(out, tag);
+    put(out, uint32_t(text.size()));
+    out += text;
+}
+
+static void encode(std::string &out, value datum)
+{
+    if (is_int(datum)) {
+        put(out, wire_int);
+        put(out, to_int(datum));
+    } else if (is_double(datum)) {
+        put(out, wire_double);
+        put(out, to_double(datum));
+    } else if (is_bool(datum)) {
+        put(out, is_false(datum) ? wire_false : wire_true);
+    } else if (is_null(datum)) {
+        put(out, wire_null);
+    } else if (is_eof_object(datum)) {
+        put(out, wire_eof);
+    } else if (is_char(datum)) {
+        put(out, wire_char);
+        put(out, char_get(datum));
+    } else if (is_string(datum)) {
+        put_text(out, wire_string, string_get(datum));
+    } else if (is_symbol(datum)) {
+        put_text(out, wire_symbol, symbol_to_string(datum));
+    } else if (is_vector(datum)) {
+        std::vector<value> elements = vector_get(datum);
+
+        put(out, wire_vector);
+        put(out, uint32_t(elements.size()));
+
+        for (value element : elements)
+            encode(out, element);
+    } else if (is_pair(datum)) {
+        size_t at = out.size() + 1;
+        uint32_t length = 0;
+
+        put(out, wire_list);
+        put(out, length);
+
+        for (; is_pair(datum); datum = cdr(datum), ++length)
+            encode(out, car(datum));
+
+        memcpy(&out[at], &length, sizeof(length));
+        encode(out, datum);
+    } else {
+        throw type_error("fork-map: cannot send result to parent", datum);
+    }
+}
+
+struct wire_reader {
+    const std::string &in;
+    size_t at = 0;
+
+    template <class T>
+    T get()
+    {
+        if (at + sizeof(T) > in.size())
+            throw runtime_error("fork-map: truncated result from worker");
+
+        T data;
+        memcpy(&data, &in[at], sizeof(T));
+        at += sizeof(T);
+        return data;
+    }
+
+    std::string get_text()
+    {
+        uint32_t size = get<uint32_t>();
+
+        if (at + size > in.size())
+            throw runtime_error("fork-map: truncated result from worker");
+
+        at += size;
+        return in.substr(at - size, size);
+    }
+
+    value decode()
+    {
+        switch (get<wire_tag>()) {
+        case wire_int:
+            return mk_int(get<int32_t>());
+        case wire_double:
+            return mk_double(get<double>());
+        case wire_true:
+            return mk_bool(true);
+        case wire_false:
+            return mk_bool(false);
+        case wire_null:
+            return list();
+        case wire_eof:
+            return mk_eof_object();
+        case wire_char:
+            return mk_char(get<uint32_t>());
+        case wire_string:
+            return mk_string(get_text());
+        case wire_symbol:
+            return string_to_symbol(get_text());
+        case wire_vector: {
+            std::vector<value> elements(get<uint32_t>(), list());
+
+            for (value &element : elements)
+                element = decode();
+
+            return mk_vector(std::move(elements));
+        }
+        case wire_list: {
+            std::vector<value> elements(get<uint32_t>(), list());
+
+            for (value &element : elements)
+                element = decode();
+
+            value result = decode();
+
+            for (auto it = elements.rbegin(); it != elements.rend(); ++it)
+                result = cons(*it, result);
+
+            return result;
+        }
+        case wire_error:
+            throw runtime_error("fork-map: worker failed: " + get_text());
+        }
+
+        throw runtime_error("fork-map: garbled result from worker");
+    }
+};
+
+static bool write_fully(int fd, const std::string &data)
+{
+    size_t written = 0;
+
+    while (written < data.size()) {
+        ssize_t result;
+        EINTR_SAFE(result, ::write, fd, data.data() + written, data.size() - written);
+
+        if (result <= 0)
+            return false;
+
+        written += size_t(result);
+    }
+
+    return true;
+}
+
+[[noreturn]] static void worker_main(int fd, value proc, const std::vector<value> &items, size_t start, size_t end)
+{
+    std::string out;
+
+    try {
+        for (size_t i = start; i < end; ++i) {
+            encode(out, apply(proc, {}, list(items[i])));
+
+            if (out.size() >= 64 * 1024) {
+                if (!write_fully(fd, out))
+                    _exit(EXIT_FAILURE);
+
+                out.clear();
+            }
+        }
+    } catch (const std::exception &e) {
+        put_text(out, wire_error, e.what());
+    }
+
+    _exit(write_fully(fd, out) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// no other thread of the isolate is in the heap or holds its locks while we
+// fork, so the child starts from a consistent heap with only itself in it
+static pid_t fork_isolate()
+{
+    world_stop stop;
+
+    isolate_t *isolate = globals::isolate();
+    std::lock_guard<std::mutex> world_lock(isolate->world_mutex);
+    std::lock_guard<std::mutex> heap_lock(isolate->heap_mutex);
+
+    // the child would have no marker thread
+    finish_concurrent_marking();
+
+    pid_t pid = ::fork();
+
+    if (pid == 0) {
+        forget_other_mutators();
+        isolate->work_pool = nullptr;
+    }
+
+    return pid;
+}
+
+static void read_results(std::vector<int> &fds, std::vector<std::string> &results)
+{
+    blocking_region blocking;
+
+    std::vector<struct pollfd> pfds;
+
+    for (int fd : fds)
+        pfds.push_back({ fd, POLLIN, 0 });
+
+    size_t n_open = fds.size();
+    char buffer[64 * 1024];
+
+    while (n_open > 0) {
+        int result;
+        EINTR_SAFE(result, ::poll, pfds.data(), nfds_t(pfds.size()), -1);
+
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (pfds[i].fd < 0 || pfds[i].revents == 0)
+                continue;
+
+            ssize_t n;
+            EINTR_SAFE(n, ::read, pfds[i].fd, buffer, sizeof(buffer));
+
+            if (n > 0) {
+                results[i].append(buffer, size_t(n));
+                continue;
+            }
+
+            ::close(pfds[i].fd);
+            fds[i] = pfds[i].fd = -1;
+            n_open--;
+        }
+    }
+}
+
+value fork_map(value proc, value lst, dot_tag, value n_workers)
+{
+    check_type(is_procedure, proc, "fork-map: expected procedure");
+
+    std::vector<value> items;
+
+    for (; is_pair(lst); lst = cdr(lst))
+        items.push_back(car(lst));
+
+    if (items.empty())
+        return list();
+
+    basic_scope roots;
+
+    for (value &item : items)
+        roots.variables.push_back(&item);
+
+    size_t n = std::max(1u, std::thread::hardware_concurrency());
+
+    if (!is_null(n_workers)) {
+        check_type(is_int, car(n_workers), "fork-map: expected worker count");
+        n = size_t(std::max(1, to_int(car(n_workers))));
+    }
+
+    n = std::min(n, items.size());
+
+    std::vector<int> fds;
+    std::vector<pid_t> pids;
+    std::string failure;
+
+    for (size_t w = 0; w < n; ++w) {
+        int pipe_fds[2];
+
+        if (::pipe(pipe_fds) == -1) {
+            failure = strerror(errno);
+            break;
+        }
+
+        pid_t pid = fork_isolate();
+
+        if (pid == 0) {
+            ::close(pipe_fds[0]);
+            worker_main(pipe_fds[1], proc, items, items.size() * w / n, items.size() * (w + 1) / n);
+        }
+
+        if (pid == -1) {
+            failure = strerror(errno);
+            ::close(pipe_fds[0]);
+            ::close(pipe_fds[1]);
+            break;
+        }
+
+        ::close(pipe_fds[1]);
+        fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+        fds.push_back(pipe_fds[0]);
+        pids.push_back(pid);
+    }
+
+    std::vector<std::string> results(fds.size());
+    read_results(fds, results);
+
+    bool all_exited = true;
+
+    for (pid_t pid : pids) {
+        int status = 0;
+        pid_t result;
+        EINTR_SAFE(result, ::waitpid, pid, &status, 0);
+
+        if (result == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            all_exited = false;
+    }
+
+    if (!failure.empty())
+        throw runtime_error("fork-map: cannot start worker: " + failure);
+
+    std::vector<value> mapped;
+    mapped.reserve(items.size());
+
+    for (const std::string &result : results) {
+        wire_reader reader { result };
+
+        while (reader.at < result.size())
+            mapped.push_back(reader.decode());
+    }
+
+    if (!all_exited || mapped.size() != items.size())
+        throw runtime_error("fork-map: worker died");
+
+    value result = list();
+
+    for (auto it = mapped.rbegin(); it != mapped.rend(); ++it)
+        result = cons(*it, result);
+
+    return result;
+}
+
+}
@@ -28,6 +28,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <poll.h>
+#include <time.h>
 
 #include <iostream>
 
@@ -82,7 +84,7 @@ static value text_of_quotation(value exp)
 
 static bool is_variable(value exp)
 {
-    return is_symbol(exp);
+    return magic::has_type_tag(exp, type_tag_symbol);
 }
 
 static bool is_assignment(value exp)
@@ -120,6 +122,16 @@ static value make_lambda(value parameters, value body)
     return cons(SYMBOL_LITERAL(lambda), cons(parameters, body));
 }
 
+static bool is_case_lambda_form(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(case-lambda));
+}
+
+static value case_lambda_clauses(value exp)
+{
+    return cdr(exp);
+}
+
 static bool is_definition(value exp)
 {
     return is_tagged_list(exp, SYMBOL_LITERAL(define));
@@ -187,7 +199,7 @@ static value rest_exps(value seq)
 
 static bool is_application(value exp)
 {
-    return is_pair(exp);
+    return magic::has_type_tag(exp, type_tag_pair);
 }
 
 static value operator_(value exp)
@@ -240,103 +252,746 @@ static value sequence_to_exp(value seq)
         return make_begin(seq);
 }
 
-static bool is_cond(value exp)
+static bool is_cond(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(cond));
+}
+
+static value cond_clauses(value exp)
+{
+    return cdr(exp);
+}
+
+static value cond_predicate(value clause)
+{
+    return car(clause);
+}
+
+static value cond_actions(value clause)
+{
+    return cdr(clause);
+}
+
+static bool is_cond_else_clause(value clause)
+{
+    return eq(cond_predicate(clause), SYMBOL_LITERAL(else));
+}
+
+static value expand_clauses(value clauses)
+{
+    if (is_null(clauses))
+        return clauses;
+
+    auto first = car(clauses);
+    auto rest = cdr(clauses);
+
+    if (is_cond_else_clause(first)) {
+        if (!is_null(rest))
+            std::cerr << "warning: cond else clause isn't last, ignoring tail: " << clauses << std::endl;
+
+        return sequence_to_exp(cond_actions(first));
+    }
+
+    return make_if(cond_predicate(first), sequence_to_exp(cond_actions(first)), expand_clauses(rest));
+}
+
+static value cond_to_if(value exp)
+{
+    return expand_clauses(cond_clauses(exp));
+}
+
+static value empty_arglist()
+{
+    return list();
+}
+
+static value adjoin_arg(value arg, value arglist)
+{
+    return append(arglist, list(arg));
+}
+
+static value splice_arg(value arg, value arglist)
+{
+    if (is_null(arg))
+        return arglist;
+
+    check_type(is_pair, arg, "splice_arg: expected list");
+    return append(arglist, arg);
+}
+
+static void bind_parameters(value env, value vars, value vals)
+{
+    if (is_symbol(vars)) {
+        environment_define(env, vars, vals);
+        return;
+    }
+
+    while (!is_null(vars)) {
+        if (eq(car(vars), SYMBOL_LITERAL(.))) {
+            environment_define(env, cadr(vars), vals);
+
+            if (!is_null(cddr(vars)))
+                throw noldor::call_error("trailing parameters after dot param", cddr(vars));
+
+            return;
+        }
+
+        if (is_null(vals))
+            throw noldor::call_error("unsatisfied function parameters", vars);
+
+        environment_define(env, car(vars), car(vals));
+        vars = cdr(vars);
+        vals = cdr(vals);
+    }
+
+    if (!is_null(vals))
+        throw noldor::call_error("too many arguments", vals);
+}
+
+static value extend_environment(value vars, value vals, value base_env)
+{
+    auto env = mk_environment(base_env);
+    bind_parameters(env, vars, vals);
+    return env;
+}
+
+// multiple values travel in the val register as the values marker, with the
+// values themselves in the mvals register; a single value is passed as-is
+
+static value values_to_value(value vals)
+{
+    if (is_pair(vals) && is_null(cdr(vals)))
+        return car(vals);
+
+    return values_marker();
+}
+
+// operands, tests and the values of definitions and assignments take one
+// value, so the marker must not get past them into a variable or a list
+static value single_value(value val, value vals)
+{
+    if (is_values_marker(val))
+        throw noldor::call_error("multiple values in single-value context", vals);
+
+    return val;
+}
+
+static value values_to_arglist(value val, value vals)
+{
+    return is_values_marker(val) ? vals : list(val);
+}
+
+static void bind_values(value env, value vars, value val, value vals)
+{
+    if (!is_values_marker(val)) {
+        if (is_pair(vars) && is_null(cdr(vars)) && !eq(car(vars), SYMBOL_LITERAL(.))) {
+            environment_define(env, car(vars), val);
+            return;
+        }
+
+        vals = list(val);
+    }
+
+    bind_parameters(env, vars, vals);
+}
+
+static bool is_receive(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(receive));
+}
+
+static value receive_formals(value exp)
+{
+    return cadr(exp);
+}
+
+static value receive_expression(value exp)
+{
+    return caddr(exp);
+}
+
+static value receive_body(value exp)
+{
+    return cdddr(exp);
+}
+
+static bool is_let_values(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(let-values));
+}
+
+static value let_values_bindings(value exp)
+{
+    return cadr(exp);
+}
+
+static value let_values_body(value exp)
+{
+    return cddr(exp);
+}
+
+static value binding_formals(value binding)
+{
+    return car(binding);
+}
+
+static value binding_init(value binding)
+{
+    return cadr(binding);
+}
+
+static bool is_define_values(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(define-values));
+}
+
+static value define_values_formals(value exp)
+{
+    return cadr(exp);
+}
+
+static value define_values_expression(value exp)
+{
+    return caddr(exp);
+}
+
+// Exception handler frames live on the thread stack. Each frame is two
+// slots: the index of the enclosing frame and the handler procedure, #f for
+// a guard. The handlers register holds the index of the innermost frame.
+// A guard frame sits on top of the prompts and winders in effect at its
+// entry.
+//
+// The winders register holds the list of active dynamic-wind entries,
+// innermost first, each a (before . after) pair. It is a list rather than a
+// stack frame so continuations can find the common ancestor to rewind from.
+
+static value no_frame()
+{
+    return mk_int(-1);
+}
+
+static bool has_frame(value index)
+{
+    return to_int(index) >= 0;
+}
+
+static bool has_no_frame(value index)
+{
+    return !has_frame(index);
+}
+
+static value top_frame_index(thread_t &thread)
+{
+    return mk_int(int32_t(thread.depth()) - 2);
+}
+
+static value frame_outer(thread_t &thread, value index)
+{
+    return thread.slot(size_t(to_int(index)));
+}
+
+static value frame_procedure(thread_t &thread, value index)
+{
+    return thread.slot(size_t(to_int(index) + 1));
+}
+
+static bool is_guard_frame(thread_t &thread, value index)
+{
+    return is_false(frame_procedure(thread, index));
+}
+
+static bool has_winders_above_guard(thread_t &thread, value winders, value index)
+{
+    return !eq(winders, thread.slot(size_t(to_int(index) - 1)));
+}
+
+static value stack_depth(thread_t &thread)
+{
+    return mk_int(int32_t(thread.depth()));
+}
+
+static void truncate_stack(thread_t &thread, value index, int32_t keep)
+{
+    thread.truncate(size_t(to_int(index) + keep));
+}
+
+static value make_winder(value before, value after, value winders)
+{
+    return cons(cons(before, after), winders);
+}
+
+static value winder_before(value winders)
+{
+    return caar(winders);
+}
+
+static value winder_after(value winders)
+{
+    return cdar(winders);
+}
+
+// running k leaves every winder not shared with k's winders, outermost last,
+// then enters k's own winders outermost first
+
+static bool must_unwind_for(value winders, value k)
+{
+    for (value w = continuation_winders(k); ; w = cdr(w)) {
+        if (eq(w, winders))
+            return false;
+        if (is_null(w))
+            return true;
+    }
+}
+
+static bool must_rewind_for(value winders, value k)
+{
+    return !eq(winders, continuation_winders(k));
+}
+
+static value next_rewind_for(value winders, value k)
+{
+    value w = continuation_winders(k);
+    while (!eq(cdr(w), winders))
+        w = cdr(w);
+
+    return w;
+}
+
+// interpreter runs active on this OS thread, innermost first
+static thread_local thread_t *running_threads = nullptr;
+
+struct running_thread_scope {
+    thread_t &thread;
+
+    running_thread_scope(thread_t &th) : thread(th)
+    {
+        thread.outer = running_threads;
+        running_threads = &thread;
+    }
+
+    ~running_thread_scope()
+    {
+        running_threads = thread.outer;
+    }
+};
+
+static bool is_foreign_continuation(thread_t &thread, value k)
+{
+    return continuation_owner(k) != thread.id;
+}
+
+// A continuation owned by an enclosing run is delivered to it by unwinding
+// the C++ frames in between; winders of the runs in between are not run.
+// One whose run has returned can only be resumed by an outermost run, where
+// finishing it means returning to the same toplevel.
+
+static void jump_to_continuation(thread_t &thread, value k, value args)
+{
+    for (thread_t *th = thread.outer; th; th = th->outer) {
+        if (th->id == continuation_owner(k))
+            throw continuation_jump { th->id, k, args };
+    }
+
+    if (thread.outer)
+        throw noldor::call_error("continuation invoked outside the evaluation that captured it", k);
+}
+
+// A reset pushes a prompt frame of three slots: its continu, the winders in
+// effect and the enclosing prompt index. The prompts register holds the
+// stack index just above the innermost prompt frame, where the slice that
+// shift captures starts.
+
+static bool is_reset(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(reset));
+}
+
+static value reset_body(value exp)
+{
+    return cdr(exp);
+}
+
+static bool is_shift(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(shift));
+}
+
+static value shift_variable(value exp)
+{
+    return cadr(exp);
+}
+
+static value shift_body(value exp)
+{
+    return cddr(exp);
+}
+
+static value prompt_winders(thread_t &thread, value prompts)
+{
+    return thread.slot(size_t(to_int(prompts) - 2));
+}
+
+static bool has_winders_above_prompt(thread_t &thread, value winders, value prompts)
+{
+    return !eq(winders, prompt_winders(thread, prompts));
+}
+
+static value capture_composable(thread_t &thread, value continu, value handlers, value winders, value prompts)
+{
+    if (!has_frame(prompts))
+        throw noldor::call_error("shift: no enclosing reset", list());
+
+    composable_continuation_t k;
+    k.base = size_t(to_int(prompts));
+    k.continu = continu;
+    k.handlers = handlers;
+    k.winders = winders;
+    k.outer_winders = prompt_winders(thread, prompts);
+
+    size_t depth = thread.depth();
+    k.slots.reserve(depth - k.base);
+
+    for (size_t index = k.base; index < depth; ++index)
+        k.slots.push_back(thread.slot(index));
+
+    return mk_composable_continuation(std::move(k));
+}
+
+static value handlers_below_prompt(thread_t &thread, value handlers, value prompts)
+{
+    while (has_frame(handlers) && to_int(handlers) >= to_int(prompts))
+        handlers = frame_outer(thread, handlers);
+
+    return handlers;
+}
+
+// keeps the reset_done continu the body of the reset left at the prompt
+static void truncate_to_prompt(thread_t &thread, value prompts)
+{
+    thread.truncate(size_t(to_int(prompts) + 1));
+}
+
+static size_t winders_between(value winders, value outer)
+{
+    size_t n = 0;
+    for (; !eq(winders, outer); winders = cdr(winders))
+        ++n;
+
+    return n;
+}
+
+static bool has_composable_rewind(thread_t &thread, value winders, value k, value prompts)
+{
+    auto data = composable_continuation_data(k);
+    return winders_between(winders, prompt_winders(thread, prompts))
+         < winders_between(data->winders, data->outer_winders);
+}
+
+// the outermost dynamic-wind entry of k not yet re-entered
+static value next_composable_winder(thread_t &thread, value winders, value k, value prompts)
+{
+    auto data = composable_continuation_data(k);
+    size_t done = winders_between(winders, prompt_winders(thread, prompts));
+    size_t total = winders_between(data->winders, data->outer_winders);
+
+    value w = data->winders;
+    for (size_t i = 0; i + 1 < total - done; ++i)
+        w = cdr(w);
+
+    return car(w);
+}
+
+// Pushes the slice of k above the prompt just pushed by composable_apply.
+// Handler frames in the slice are moved to their new stack indices and the
+// outermost one is linked to the handlers of the caller; guard frames get
+// the new prompt and the rewound copies of their winders.
+
+static void composable_reinstate(thread_t &thread, value k)
+{
+    auto data = composable_continuation_data(k);
+    std::vector<uint64_t> slots = data->slots;
+
+    const int32_t base = int32_t(data->base);
+    const value prompts = thread.getreg(reg::prompts);
+    const int32_t delta = to_int(prompts) - base;
+    const value caller_handlers = thread.getreg(reg::handlers);
+
+    auto relocate_winders = [&] (value old) -> value {
+        value w = data->winders;
+        value rewound = thread.getreg(reg::winders);
+
+        for (; !eq(w, data->outer_winders); w = cdr(w), rewound = cdr(rewound)) {
+            if (eq(w, old))
+                return rewound;
+        }
+
+        return rewound;
+    };
+
+    auto relocate_handlers = [&] (value index) -> value {
+        return has_frame(index) && to_int(index) >= base ? mk_int(to_int(index) + delta)
+                                                         : caller_handlers;
+    };
+
+    for (value h = data->handlers; has_frame(h) && to_int(h) >= base;) {
+        size_t local = size_t(to_int(h) - base);
+        value outer = slots.at(local);
+
+        if (is_false(slots.at(local + 1))) {
+            slots.at(local - 1) = relocate_winders(slots.at(local - 1));
+            slots.at(local - 2) = prompts;
+        }
+
+        slots.at(local) = relocate_handlers(outer);
+        h = outer;
+    }
+
+    thread.stack.insert(thread.stack.end(), slots.begin(), slots.end());
+    thread.assign(reg::handlers, relocate_handlers(data->handlers));
+    thread.assign(reg::continu, data->continu);
+}
+
+static value raise_uncaught(value obj)
+{
+    throw noldor::raise_error("uncaught raise", obj);
+}
+
+static bool is_guard(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(guard));
+}
+
+static value guard_variable(value exp)
+{
+    return caadr(exp);
+}
+
+static value guard_body(value exp)
+{
+    return cddr(exp);
+}
+
+static value guard_clauses_to_cond(value exp)
+{
+    value clauses = cdadr(exp);
+    value last = clauses;
+
+    while (is_pair(last) && !is_null(cdr(last)))
+        last = cdr(last);
+
+    if (is_null(last) || !is_cond_else_clause(car(last))) {
+        value reraise = list(SYMBOL_LITERAL(else), list(SYMBOL_LITERAL(raise-continuable), guard_variable(exp)));
+        clauses = append(clauses, list(reraise));
+    }
+
+    return cons(SYMBOL_LITERAL(cond), clauses);
+}
+
+static bool is_future_form(value exp)
+{
+    return is_tagged_list(exp, SYMBOL_LITERAL(future));
+}
+
+static value future_to_make_future(value exp)
+{
+    return list(SYMBOL_LITERAL(make-future), make_lambda(list(), cdr(exp)));
+}
+
+// An outermost run owns a primordial green thread for its own stack and may
+// switch to other green threads. Nested runs never switch: the green thread
+// that entered them is pinned to the C++ frames in between.
+
+struct green_thread_scope {
+    thread_t &root;
+    const bool outermost;
+    const bool saved_can_park;
+    value primordial = list();
+    value saved_current = list();
+    basic_scope roots { &primordial, &saved_current };
+
+    green_thread_scope(thread_t &th)
+        : root(th)
+        , outermost(!th.outer)
+        , saved_can_park(scheduler_can_park())
+    {
+        saved_current = current_thread();
+
+        if (outermost) {
+            primordial = mk_primordial_thread(root);
+            scheduler_set_current(primordial);
+        }
+
+        scheduler_set_can_park(outermost);
+    }
+
+    ~green_thread_scope()
+    {
+        if (outermost) {
+            scheduler_forget(primordial);
+
+            if (green_thread_data(primordial)->status != green_thread_terminated)
+                scheduler_terminate(primordial, mk_bool(false), false);
+
+            green_thread_data(primordial)->thread = nullptr;
+            scheduler_set_current(saved_current);
+        }
+
+        scheduler_set_can_park(saved_can_park);
+    }
+
+    void finish(value result)
+    {
+        if (outermost)
+            scheduler_terminate(primordial, result, false);
+    }
+
+    uint64_t switch_to_next(thread_t *&current)
+    {
+        try {
+            auto data = green_thread_data(scheduler_next());
+            current = data->thread;
+            return data->resume;
+        } catch (...) {
+            scheduler_forget(primordial);
+            scheduler_set_current(primordial);
+            current = &root;
+            throw;
+        }
+    }
+};
+
+static bool cannot_switch_thread()
+{
+    return !scheduler_can_park() || !scheduler_has_other_threads();
+}
+
+static void check_can_block(value t)
+{
+    if (!scheduler_can_park())
+        throw noldor::call_error("thread-join!: cannot wait inside a nested evaluation", t);
+}
+
+static double seconds_argument(const char *who, value arg)
+{
+    if (is_int(arg))
+        return to_int(arg);
+
+    check_type(is_double, arg, who);
+    return to_double(arg);
+}
+
+static double sleep_seconds(value argl)
+{
+    return seconds_argument("thread-sleep!: expected number of seconds", car(argl));
+}
+
+static void sleep_blocking(value argl)
+{
+    double seconds = std::max(sleep_seconds(argl), 0.0);
+    struct timespec ts = { time_t(seconds), long((seconds - double(time_t(seconds))) * 1e9) };
+    blocking_region blocking;
+
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        ;
+}
+
+static value wait_ports_list(value argl)
 {
-    return is_tagged_list(exp, SYMBOL_LITERAL(cond));
+    for (value p = car(argl); !is_null(p); p = cdr(p))
+        check_type(is_port, car(p), "wait-ports: expected list of ports");
+
+    return car(argl);
 }
 
-static value cond_clauses(value exp)
+// negative when wait-ports was given no timeout
+static double wait_ports_timeout(value argl)
 {
-    return cdr(exp);
+    if (is_null(cdr(argl)))
+        return -1;
+
+    return std::max(seconds_argument("wait-ports: expected timeout in seconds", cadr(argl)), 0.0);
 }
 
-static value cond_predicate(value clause)
+static bool is_port_ready(value port)
 {
-    return car(clause);
+    return port_fd(port) == -1 || !is_input_port(port) || is_char_ready(port);
 }
 
-static value cond_actions(value clause)
+static value ready_ports(value argl)
 {
-    return cdr(clause);
+    value ready = list();
+
+    for (value p = wait_ports_list(argl); !is_null(p); p = cdr(p)) {
+        if (is_port_ready(car(p)))
+            ready = cons(car(p), ready);
+    }
+
+    return reverse(ready);
 }
 
-static bool is_cond_else_clause(value clause)
+static bool is_wait_over(value ready, value argl)
 {
-    return eq(cond_predicate(clause), SYMBOL_LITERAL(else));
+    return !is_null(ready) || wait_ports_timeout(argl) == 0;
 }
 
-static value expand_clauses(value clauses)
+static value wait_ports_blocking(value argl)
 {
-    if (is_null(clauses))
-        return clauses;
+    basic_scope roots { &argl };
+    std::vector<struct pollfd> pfds;
 
-    auto first = car(clauses);
-    auto rest = cdr(clauses);
+    for (value p = wait_ports_list(argl); !is_null(p); p = cdr(p))
+        pfds.push_back({ port_fd(car(p)), POLLIN, 0 });
 
-    if (is_cond_else_clause(first)) {
-        if (!is_null(rest))
-            std::cerr << "warning: cond else clause isn't last, ignoring tail: " << clauses << std::endl;
+    double timeout = wait_ports_timeout(argl);
 
-        return sequence_to_exp(cond_actions(first));
+    {
+        blocking_region blocking;
+
+        int result;
+        EINTR_SAFE(result, ::poll, pfds.data(), nfds_t(pfds.size()), timeout < 0 ? -1 : int(timeout * 1000));
     }
 
-    return make_if(cond_predicate(first), sequence_to_exp(cond_actions(first)), expand_clauses(rest));
+    return ready_ports(argl);
 }
 
-static value cond_to_if(value exp)
+static void wait_ports_park(value t, value argl)
 {
-    return expand_clauses(cond_clauses(exp));
+    for (value p = wait_ports_list(argl); !is_null(p); p = cdr(p))
+        scheduler_wait_fd(t, port_fd(car(p)), POLLIN);
+
+    double timeout = wait_ports_timeout(argl);
+    if (timeout >= 0)
+        scheduler_wait_timer(t, timeout);
 }
 
-static value empty_arglist()
+static bool is_thread_terminated(value t)
 {
-    return list();
+    return green_thread_data(t)->status == green_thread_terminated;
 }
 
-static value adjoin_arg(value arg, value arglist)
+static bool has_thread_failed(value t)
 {
-    return append(arglist, list(arg));
+    return green_thread_data(t)->failed;
 }
 
-static value splice_arg(value arg, value arglist)
+static value thread_result(value t)
 {
-    if (is_null(arg))
-        return arglist;
-
-    check_type(is_pair, arg, "splice_arg: expected list");
-    return append(arglist, arg);
+    return green_thread_data(t)->result;
 }
 
-static value extend_environment(value vars, value vals, value base_env)
+static value spread_arguments(value args)
 {
-    auto env = mk_environment(base_env);
+    if (is_null(args))
+        return args;
 
-    while (!is_null(vars) && !is_null(vals)) {
-        if (eq(car(vars), SYMBOL_LITERAL(.))) {
-            environment_define(env, cadr(vars), vals);
-            vars = cddr(vars);
-            vals = list();
-
-            if (!is_null(vars))
-                throw noldor::call_error("trailing parameters after dot param", vars);
-        } else {
-            environment_define(env, car(vars), car(vals));
-            vars = cdr(vars);
-            vals = cdr(vals);
-        }
+    if (is_null(cdr(args))) {
+        check_type(is_list, car(args), "apply: expected list as last argument");
+        return car(args);
     }
 
-    if (!is_null(vars))
-        throw noldor::call_error("unsatisfied function parameters", vars);
-
-    if (!is_null(vals))
-        throw noldor::call_error("too many arguments", vals);
-
-    return env;
+    return cons(car(args), spread_arguments(cdr(args)));
 }
 
-static value interpret(value exp, value env)
-{
 #define X_LABELS(X) \
  X(unknown_expression_type) \
  X(unknown_procedure_type) \
@@ -355,6 +1010,7 @@ static value interpret(value exp, value env)
  X(ev_qq_arg_unquote) \
  X(en_qq_arg_dispatch) \
  X(ev_lambda) \
+ X(ev_case_lambda) \
  X(ev_application) \
  X(ev_appl_did_operator) \
  X(ev_appl_operand_loop) \
@@ -364,6 +1020,7 @@ static value interpret(value exp, value env)
  X(apply_dispatch) \
  X(primitive_apply) \
  X(compound_apply) \
+ X(case_lambda_apply) \
  X(ev_begin) \
  X(ev_sequence) \
  X(ev_sequence_continue) \
@@ -375,12 +1032,93 @@ static value interpret(value exp, value env)
  X(ev_assignment) \
  X(ev_assignment_1) \
  X(ev_definition) \
- X(ev_definition_1)
+ X(ev_definition_1) \
+ X(ev_receive) \
+ X(ev_receive_bind) \
+ X(ev_let_values) \
+ X(ev_let_values_loop) \
+ X(ev_let_values_bind) \
+ X(ev_let_values_body) \
+ X(ev_define_values) \
+ X(ev_define_values_1) \
+ X(apply_entry) \
+ X(control_apply) \
+ X(ctl_values) \
+ X(ctl_call_with_values) \
+ X(ctl_cwv_consume) \
+ X(ctl_apply) \
+ X(ctl_call_cc) \
+ X(continuation_apply) \
+ X(continuation_local) \
+ X(continuation_wind) \
+ X(continuation_unwind) \
+ X(continuation_rewind) \
+ X(continuation_rewound) \
+ X(continuation_foreign) \
+ X(ev_reset) \
+ X(reset_done) \
+ X(ev_shift) \
+ X(shift_unwind) \
+ X(shift_unwind_after) \
+ X(composable_apply) \
+ X(composable_rewind) \
+ X(composable_rewind_before) \
+ X(composable_rewound) \
+ X(schedule) \
+ X(thread_resume) \
+ X(thread_exit) \
+ X(ctl_thread_yield) \
+ X(ctl_thread_join) \
+ X(join_resume) \
+ X(ctl_thread_sleep) \
+ X(ctl_wait_ports) \
+ X(wait_ports_resume) \
+ X(thread_sleep_park) \
+ X(wait_ports_park) \
+ X(ev_future) \
+ X(ev_guard) \
+ X(guard_done) \
+ X(guard_unwind) \
+ X(guard_unwind_loop) \
+ X(guard_unwind_after) \
+ X(ctl_with_exception_handler) \
+ X(weh_done) \
+ X(ctl_raise) \
+ X(ctl_raise_continuable) \
+ X(ctl_error) \
+ X(signal_raise) \
+ X(signal_dispatch) \
+ X(raise_return) \
+ X(raise_continuable_return) \
+ X(raise_uncaught) \
+ X(ctl_dynamic_wind) \
+ X(dw_before_done) \
+ X(dw_thunk_done) \
+ X(dw_after_done)
 
 #define X(LABEL) LABEL_##LABEL,
 enum : uint64_t { X_LABELS(X) };
 #undef X
 
+#define X_CONTROL_PROCEDURES(X) \
+    X("values",                   ctl_values          ) \
+    X("call-with-values",         ctl_call_with_values) \
+    X("apply",                    ctl_apply           ) \
+    X("call-with-current-continuation", ctl_call_cc   ) \
+    X("call/cc",                  ctl_call_cc         ) \
+    X("with-exception-handler",   ctl_with_exception_handler) \
+    X("raise",                    ctl_raise           ) \
+    X("raise-continuable",        ctl_raise_continuable) \
+    X("error",                    ctl_error           ) \
+    X("dynamic-wind",             ctl_dynamic_wind    ) \
+    X("thread-yield!",            ctl_thread_yield    ) \
+    X("thread-join!",             ctl_thread_join     ) \
+    X("thread-sleep!",            ctl_thread_sleep    ) \
+    X("wait-ports",               ctl_wait_ports      )
+
+static value interpret(uint64_t entry, value exp, value env, value proc, value argl)
+{
+
 //#define NOLDOR_TRACE_INTERPRETER
 
 #ifdef NOLDOR_TRACE_INTERPRETER
@@ -419,9 +1157,9 @@ auto trace_args = [] (std::initializer_list<std::string> parts) -> std::string {
 #define GOTO(DEST)       { TRACE(4, GOTO,    #DEST);      DISPATCH(DEST);                     }
 #define BRANCH(DEST)     { TRACE(4, BRANCH,  #DEST);      DISPATCH(DEST);                     }
 
-#define ASSIGN(REG, VAL) { TRACE(4, ASSIGN,  #REG, #VAL); thread.assign(reg::REG, VAL);       }
-#define RESTORE(REG)     { TRACE(4, RESTORE, #REG);       thread.restore(reg::REG);           }
-#define SAVE(REG)        { TRACE(4, SAVE,    #REG);       thread.save(reg::REG);              }
+#define ASSIGN(REG, VAL) { TRACE(4, ASSIGN,  #REG, #VAL); THREAD.assign(reg::REG, VAL);       }
+#define RESTORE(REG)     { TRACE(4, RESTORE, #REG);       THREAD.restore(reg::REG);           }
+#define SAVE(REG)        { TRACE(4, SAVE,    #REG);       THREAD.save(reg::REG);              }
 #define ERROR(MSG, IRR)  { TRACE(4, ERROR,   MSG, #IRR);  throw noldor::base_error(MSG, IRR); }
 #define PERFORM(ACTION)  { TRACE(4, PERFORM, #ACTION);    ACTION;                             }
 #define TEST(tst)          TRACE(4, TEST,    #tst);       if (tst)
@@ -429,20 +1167,38 @@ auto trace_args = [] (std::initializer_list<std::string> parts) -> std::string {
 
 #define CONST(NAME)        SYMBOL_LITERAL(NAME)
 #define LABEL(NAME)        LABEL_##NAME
-#define REG(NAME)          thread.getreg(reg::NAME)
+#define REG(NAME)          THREAD.getreg(reg::NAME)
 #define OP(O, ...)         O(__VA_ARGS__)
+#define THREAD             (*current)
+
+    thread_t root;
+    thread_scope_t tsc(root);
+    running_thread_scope running(root);
+    green_thread_scope green(root);
 
-    thread_t thread;
-    thread_scope_t tsc(thread);
+    thread_t *current = &root;
 
     ASSIGN(exp, exp)
     ASSIGN(env, env)
+    ASSIGN(proc, proc)
+    ASSIGN(argl, argl)
     ASSIGN(continu, LABEL(eval_finished))
+    ASSIGN(handlers, OP(no_frame,))
+    ASSIGN(winders, OP(list,))
+    ASSIGN(prompts, OP(no_frame,))
+
+    // errors thrown by primitives become Scheme conditions when there is a
+    // handler to deliver them to, otherwise they propagate to the caller
+    uint64_t resume = entry;
+
+    while (true) {
+        try {
 
 ENTER_INTERPRETER
-    GOTO(LABEL(eval_dispatch))
+    GOTO(resume)
 
 MAKE_LABEL(eval_finished)
+    PERFORM(green.finish(REG(val)))
     RETURN(REG(val))
 
 MAKE_LABEL(unknown_expression_type)
@@ -479,12 +1235,36 @@ MAKE_LABEL(eval_dispatch)
     TEST(OP(is_lambda, REG(exp)))
     BRANCH(LABEL(ev_lambda))
 
+    TEST(OP(is_case_lambda_form, REG(exp)))
+    BRANCH(LABEL(ev_case_lambda))
+
     TEST(OP(is_begin, REG(exp)))
     BRANCH(LABEL(ev_begin))
 
     TEST(OP(is_cond, REG(exp)))
     BRANCH(LABEL(ev_cond))
 
+    TEST(OP(is_receive, REG(exp)))
+    BRANCH(LABEL(ev_receive))
+
+    TEST(OP(is_let_values, REG(exp)))
+    BRANCH(LABEL(ev_let_values))
+
+    TEST(OP(is_define_values, REG(exp)))
+    BRANCH(LABEL(ev_define_values))
+
+    TEST(OP(is_guard, REG(exp)))
+    BRANCH(LABEL(ev_guard))
+
+    TEST(OP(is_future_form, REG(exp)))
+    BRANCH(LABEL(ev_future))
+
+    TEST(OP(is_reset, REG(exp)))
+    BRANCH(LABEL(ev_reset))
+
+    TEST(OP(is_shift, REG(exp)))
+    BRANCH(LABEL(ev_shift))
+
     TEST(OP(is_application, REG(exp)))
     BRANCH(LABEL(ev_application))
 
@@ -494,6 +1274,10 @@ MAKE_LABEL(ev_cond)
     ASSIGN(exp, OP(cond_to_if, REG(exp)))
     GOTO(LABEL(eval_dispatch))
 
+MAKE_LABEL(ev_future)
+    ASSIGN(exp, OP(future_to_make_future, REG(exp)))
+    GOTO(LABEL(eval_dispatch))
+
 MAKE_LABEL(ev_self_eval)
     ASSIGN(val, REG(exp))
     GOTO(REG(continu))
@@ -568,6 +1352,10 @@ MAKE_LABEL(ev_lambda)
     ASSIGN(val, OP(mk_procedure, REG(unev), REG(exp), REG(env)))
     GOTO(REG(continu))
 
+MAKE_LABEL(ev_case_lambda)
+    ASSIGN(val, OP(mk_case_lambda, OP(case_lambda_clauses, REG(exp)), REG(env)))
+    GOTO(REG(continu))
+
 MAKE_LABEL(ev_application)
     SAVE(continu)
     SAVE(env)
@@ -601,6 +1389,7 @@ MAKE_LABEL(ev_appl_accumulate_arg)
     RESTORE(unev)
     RESTORE(env)
     RESTORE(argl)
+    ASSIGN(val, OP(single_value, REG(val), REG(mvals)))
     ASSIGN(argl, OP(adjoin_arg, REG(val), REG(argl)))
     ASSIGN(unev, OP(rest_operands, REG(unev)))
     GOTO(LABEL(ev_appl_operand_loop))
@@ -611,15 +1400,25 @@ MAKE_LABEL(ev_appl_last_arg)
 
 MAKE_LABEL(ev_appl_accum_last_arg)
     RESTORE(argl)
+    ASSIGN(val, OP(single_value, REG(val), REG(mvals)))
     ASSIGN(argl, OP(adjoin_arg, REG(val), REG(argl)))
     RESTORE(proc)
     GOTO(LABEL(apply_dispatch))
 
 MAKE_LABEL(apply_dispatch)
+    PERFORM(OP(safepoint,))
     TEST(OP(is_primitive_procedure, REG(proc)))
     BRANCH(LABEL(primitive_apply))
     TEST(OP(is_compound_procedure, REG(proc)))
     BRANCH(LABEL(compound_apply))
+    TEST(OP(is_case_lambda, REG(proc)))
+    BRANCH(LABEL(case_lambda_apply))
+    TEST(OP(is_control_procedure, REG(proc)))
+    BRANCH(LABEL(control_apply))
+    TEST(OP(is_continuation, REG(proc)))
+    BRANCH(LABEL(continuation_apply))
+    TEST(OP(is_composable_continuation, REG(proc)))
+    BRANCH(LABEL(composable_apply))
     GOTO(LABEL(unknown_procedure_type))
 
 MAKE_LABEL(primitive_apply)
@@ -634,6 +1433,242 @@ MAKE_LABEL(compound_apply)
     ASSIGN(unev, OP(procedure_body, REG(proc)))
     GOTO(LABEL(ev_sequence))
 
+MAKE_LABEL(case_lambda_apply)
+    ASSIGN(proc, OP(case_lambda_select, REG(proc), REG(argl)))
+    GOTO(LABEL(compound_apply))
+
+MAKE_LABEL(control_apply)
+    GOTO(OP(control_procedure_label, REG(proc)))
+
+MAKE_LABEL(apply_entry)
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(ctl_values)
+    ASSIGN(mvals, REG(argl))
+    ASSIGN(val, OP(values_to_value, REG(argl)))
+    RESTORE(continu)
+    GOTO(REG(continu))
+
+MAKE_LABEL(ctl_call_with_values)
+    ASSIGN(val, OP(cadr, REG(argl)))
+    SAVE(val)
+    ASSIGN(proc, OP(car, REG(argl)))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(ctl_cwv_consume))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(ctl_cwv_consume)
+    RESTORE(proc)
+    ASSIGN(argl, OP(values_to_arglist, REG(val), REG(mvals)))
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(ctl_apply)
+    ASSIGN(proc, OP(car, REG(argl)))
+    ASSIGN(argl, OP(spread_arguments, OP(cdr, REG(argl))))
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(ctl_call_cc)
+    ASSIGN(val, OP(mk_continuation, THREAD, REG(handlers), REG(winders), REG(prompts)))
+    ASSIGN(proc, OP(car, REG(argl)))
+    ASSIGN(argl, OP(list, REG(val)))
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(continuation_apply)
+    TEST(OP(is_foreign_continuation, THREAD, REG(proc)))
+    BRANCH(LABEL(continuation_foreign))
+    GOTO(LABEL(continuation_local))
+
+MAKE_LABEL(continuation_local)
+    ASSIGN(mvals, REG(argl))
+    ASSIGN(val, OP(values_to_value, REG(argl)))
+    SAVE(val)
+    SAVE(mvals)
+    SAVE(proc)
+    GOTO(LABEL(continuation_wind))
+
+MAKE_LABEL(continuation_wind)
+    RESTORE(proc)
+    TEST(OP(must_unwind_for, REG(winders), REG(proc)))
+    BRANCH(LABEL(continuation_unwind))
+    TEST(OP(must_rewind_for, REG(winders), REG(proc)))
+    BRANCH(LABEL(continuation_rewind))
+    RESTORE(mvals)
+    RESTORE(val)
+    PERFORM(OP(continuation_reinstate, THREAD, REG(proc)))
+    RESTORE(continu)
+    GOTO(REG(continu))
+
+MAKE_LABEL(continuation_unwind)
+    SAVE(proc)
+    ASSIGN(proc, OP(winder_after, REG(winders)))
+    ASSIGN(winders, OP(cdr, REG(winders)))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(continuation_wind))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(continuation_rewind)
+    SAVE(proc)
+    ASSIGN(proc, OP(winder_before, OP(next_rewind_for, REG(winders), REG(proc))))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(continuation_rewound))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(continuation_rewound)
+    RESTORE(proc)
+    ASSIGN(winders, OP(next_rewind_for, REG(winders), REG(proc)))
+    SAVE(proc)
+    GOTO(LABEL(continuation_wind))
+
+MAKE_LABEL(continuation_foreign)
+    PERFORM(OP(jump_to_continuation, THREAD, REG(proc), REG(argl)))
+    GOTO(LABEL(continuation_local))
+
+MAKE_LABEL(ev_reset)
+    SAVE(continu)
+    SAVE(winders)
+    SAVE(prompts)
+    ASSIGN(prompts, OP(stack_depth, THREAD))
+    ASSIGN(unev, OP(reset_body, REG(exp)))
+    ASSIGN(continu, LABEL(reset_done))
+    SAVE(continu)
+    GOTO(LABEL(ev_sequence))
+
+MAKE_LABEL(reset_done)
+    RESTORE(prompts)
+    RESTORE(winders)
+    RESTORE(continu)
+    GOTO(REG(continu))
+
+MAKE_LABEL(ev_shift)
+    ASSIGN(val, OP(capture_composable, THREAD, REG(continu), REG(handlers), REG(winders), REG(prompts)))
+    ASSIGN(handlers, OP(handlers_below_prompt, THREAD, REG(handlers), REG(prompts)))
+    PERFORM(OP(truncate_to_prompt, THREAD, REG(prompts)))
+    SAVE(exp)
+    SAVE(env)
+    SAVE(val)
+    GOTO(LABEL(shift_unwind))
+
+MAKE_LABEL(shift_unwind)
+    RESTORE(val)
+    TEST(OP(has_winders_above_prompt, THREAD, REG(winders), REG(prompts)))
+    BRANCH(LABEL(shift_unwind_after))
+    RESTORE(env)
+    RESTORE(exp)
+    ASSIGN(env, OP(mk_environment, REG(env)))
+    PERFORM(OP(environment_define, REG(env), OP(shift_variable, REG(exp)), REG(val)))
+    ASSIGN(unev, OP(shift_body, REG(exp)))
+    GOTO(LABEL(ev_sequence))
+
+MAKE_LABEL(shift_unwind_after)
+    SAVE(val)
+    ASSIGN(proc, OP(winder_after, REG(winders)))
+    ASSIGN(winders, OP(cdr, REG(winders)))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(shift_unwind))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(composable_apply)
+    SAVE(winders)
+    SAVE(prompts)
+    ASSIGN(prompts, OP(stack_depth, THREAD))
+    ASSIGN(mvals, REG(argl))
+    ASSIGN(val, OP(values_to_value, REG(argl)))
+    SAVE(val)
+    SAVE(mvals)
+    SAVE(proc)
+    GOTO(LABEL(composable_rewind))
+
+MAKE_LABEL(composable_rewind)
+    RESTORE(proc)
+    TEST(OP(has_composable_rewind, THREAD, REG(winders), REG(proc), REG(prompts)))
+    BRANCH(LABEL(composable_rewind_before))
+    RESTORE(mvals)
+    RESTORE(val)
+    PERFORM(OP(composable_reinstate, THREAD, REG(proc)))
+    GOTO(REG(continu))
+
+MAKE_LABEL(composable_rewind_before)
+    SAVE(proc)
+    ASSIGN(proc, OP(car, OP(next_composable_winder, THREAD, REG(winders), REG(proc), REG(prompts))))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(composable_rewound))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(composable_rewound)
+    RESTORE(proc)
+    ASSIGN(winders, OP(cons, OP(next_composable_winder, THREAD, REG(winders), REG(proc), REG(prompts)), REG(winders)))
+    SAVE(proc)
+    GOTO(LABEL(composable_rewind))
+
+MAKE_LABEL(schedule)
+    GOTO(green.switch_to_next(current))
+
+MAKE_LABEL(thread_resume)
+    RESTORE(continu)
+    GOTO(REG(continu))
+
+MAKE_LABEL(thread_exit)
+    PERFORM(OP(scheduler_terminate, OP(current_thread,), REG(val), false))
+    GOTO(LABEL(schedule))
+
+MAKE_LABEL(ctl_thread_yield)
+    ASSIGN(val, CONST(ok))
+    TEST(OP(cannot_switch_thread,))
+    BRANCH(LABEL(thread_resume))
+    PERFORM(OP(scheduler_make_runnable, OP(current_thread,), LABEL(thread_resume)))
+    GOTO(LABEL(schedule))
+
+MAKE_LABEL(ctl_thread_join)
+    ASSIGN(proc, OP(car, REG(argl)))
+    TEST(OP(is_thread_terminated, REG(proc)))
+    BRANCH(LABEL(join_resume))
+    PERFORM(OP(check_can_block, REG(proc)))
+    PERFORM(OP(scheduler_wait_join, OP(current_thread,), REG(proc), LABEL(join_resume)))
+    GOTO(LABEL(schedule))
+
+MAKE_LABEL(join_resume)
+    ASSIGN(val, OP(thread_result, REG(proc)))
+    TEST(OP(has_thread_failed, REG(proc)))
+    BRANCH(LABEL(signal_raise))
+    RESTORE(continu)
+    GOTO(REG(continu))
+
+MAKE_LABEL(ctl_thread_sleep)
+    ASSIGN(val, CONST(ok))
+    TEST(OP(scheduler_can_park,))
+    BRANCH(LABEL(thread_sleep_park))
+    PERFORM(OP(sleep_blocking, REG(argl)))
+    GOTO(LABEL(thread_resume))
+
+MAKE_LABEL(thread_sleep_park)
+    PERFORM(OP(scheduler_block, OP(current_thread,), LABEL(thread_resume)))
+    PERFORM(OP(scheduler_wait_timer, OP(current_thread,), OP(sleep_seconds, REG(argl))))
+    GOTO(LABEL(schedule))
+
+MAKE_LABEL(ctl_wait_ports)
+    ASSIGN(val, OP(ready_ports, REG(argl)))
+    TEST(OP(is_wait_over, REG(val), REG(argl)))
+    BRANCH(LABEL(thread_resume))
+    TEST(OP(scheduler_can_park,))
+    BRANCH(LABEL(wait_ports_park))
+    ASSIGN(val, OP(wait_ports_blocking, REG(argl)))
+    GOTO(LABEL(thread_resume))
+
+MAKE_LABEL(wait_ports_park)
+    PERFORM(OP(scheduler_block, OP(current_thread,), LABEL(wait_ports_resume)))
+    PERFORM(OP(wait_ports_park, OP(current_thread,), REG(argl)))
+    GOTO(LABEL(schedule))
+
+MAKE_LABEL(wait_ports_resume)
+    ASSIGN(val, OP(ready_ports, REG(argl)))
+    GOTO(LABEL(thread_resume))
+
 MAKE_LABEL(ev_begin)
     ASSIGN(unev, OP(begin_actions, REG(exp)))
     SAVE(continu)
@@ -670,6 +1705,7 @@ MAKE_LABEL(ev_if_decide)
     RESTORE(continu)
     RESTORE(env)
     RESTORE(exp)
+    ASSIGN(val, OP(single_value, REG(val), REG(mvals)))
     TEST(OP(is_false, REG(val)))
     BRANCH(LABEL(ev_if_alternative))
     GOTO(LABEL(ev_if_consequent))
@@ -695,6 +1731,7 @@ MAKE_LABEL(ev_assignment_1)
     RESTORE(continu)
     RESTORE(env)
     RESTORE(unev)
+    ASSIGN(val, OP(single_value, REG(val), REG(mvals)))
     PERFORM(OP(environment_set, REG(env), REG(unev), REG(val)))
     ASSIGN(val, CONST(ok))
     GOTO(REG(continu))
@@ -712,11 +1749,252 @@ MAKE_LABEL(ev_definition_1)
     RESTORE(continu)
     RESTORE(env)
     RESTORE(unev)
+    ASSIGN(val, OP(single_value, REG(val), REG(mvals)))
     PERFORM(OP(environment_define, REG(env), REG(unev), REG(val)))
     ASSIGN(val, CONST(ok))
     GOTO(REG(continu))
 
+MAKE_LABEL(ev_receive)
+    SAVE(exp)
+    SAVE(env)
+    SAVE(continu)
+    ASSIGN(continu, LABEL(ev_receive_bind))
+    ASSIGN(exp, OP(receive_expression, REG(exp)))
+    GOTO(LABEL(eval_dispatch))
+
+MAKE_LABEL(ev_receive_bind)
+    RESTORE(continu)
+    RESTORE(env)
+    RESTORE(exp)
+    ASSIGN(env, OP(mk_environment, REG(env)))
+    PERFORM(OP(bind_values, REG(env), OP(receive_formals, REG(exp)), REG(val), REG(mvals)))
+    ASSIGN(unev, OP(receive_body, REG(exp)))
+    SAVE(continu)
+    GOTO(LABEL(ev_sequence))
+
+MAKE_LABEL(ev_let_values)
+    SAVE(continu)
+    SAVE(exp)
+    ASSIGN(unev, OP(let_values_bindings, REG(exp)))
+    ASSIGN(argl, OP(mk_environment, REG(env)))
+    GOTO(LABEL(ev_let_values_loop))
+
+MAKE_LABEL(ev_let_values_loop)
+    TEST(OP(has_no_operands, REG(unev)))
+    BRANCH(LABEL(ev_let_values_body))
+    SAVE(argl)
+    SAVE(env)
+    SAVE(unev)
+    ASSIGN(exp, OP(binding_init, OP(first_operand, REG(unev))))
+    ASSIGN(continu, LABEL(ev_let_values_bind))
+    GOTO(LABEL(eval_dispatch))
+
+MAKE_LABEL(ev_let_values_bind)
+    RESTORE(unev)
+    RESTORE(env)
+    RESTORE(argl)
+    PERFORM(OP(bind_values, REG(argl), OP(binding_formals, OP(first_operand, REG(unev))), REG(val), REG(mvals)))
+    ASSIGN(unev, OP(rest_operands, REG(unev)))
+    GOTO(LABEL(ev_let_values_loop))
+
+MAKE_LABEL(ev_let_values_body)
+    ASSIGN(env, REG(argl))
+    RESTORE(exp)
+    ASSIGN(unev, OP(let_values_body, REG(exp)))
+    GOTO(LABEL(ev_sequence))
+
+MAKE_LABEL(ev_define_values)
+    SAVE(exp)
+    SAVE(env)
+    SAVE(continu)
+    ASSIGN(continu, LABEL(ev_define_values_1))
+    ASSIGN(exp, OP(define_values_expression, REG(exp)))
+    GOTO(LABEL(eval_dispatch))
+
+MAKE_LABEL(ev_define_values_1)
+    RESTORE(continu)
+    RESTORE(env)
+    RESTORE(exp)
+    PERFORM(OP(bind_values, REG(env), OP(define_values_formals, REG(exp)), REG(val), REG(mvals)))
+    ASSIGN(val, CONST(ok))
+    GOTO(REG(continu))
+
+MAKE_LABEL(ev_guard)
+    SAVE(continu)
+    SAVE(env)
+    SAVE(exp)
+    SAVE(prompts)
+    SAVE(winders)
+    SAVE(handlers)
+    ASSIGN(val, OP(mk_bool, false))
+    SAVE(val)
+    ASSIGN(handlers, OP(top_frame_index, THREAD))
+    ASSIGN(unev, OP(guard_body, REG(exp)))
+    ASSIGN(continu, LABEL(guard_done))
+    SAVE(continu)
+    GOTO(LABEL(ev_sequence))
+
+MAKE_LABEL(guard_done)
+    RESTORE(unev)
+    RESTORE(handlers)
+    RESTORE(winders)
+    RESTORE(prompts)
+    RESTORE(exp)
+    RESTORE(env)
+    RESTORE(continu)
+    GOTO(REG(continu))
+
+MAKE_LABEL(guard_unwind)
+    SAVE(val)
+    SAVE(handlers)
+    GOTO(LABEL(guard_unwind_loop))
+
+MAKE_LABEL(guard_unwind_loop)
+    RESTORE(handlers)
+    TEST(OP(has_winders_above_guard, THREAD, REG(winders), REG(handlers)))
+    BRANCH(LABEL(guard_unwind_after))
+    RESTORE(val)
+    PERFORM(OP(truncate_stack, THREAD, REG(handlers), 1))
+    RESTORE(handlers)
+    RESTORE(winders)
+    RESTORE(prompts)
+    RESTORE(exp)
+    RESTORE(env)
+    ASSIGN(env, OP(mk_environment, REG(env)))
+    PERFORM(OP(environment_define, REG(env), OP(guard_variable, REG(exp)), REG(val)))
+    ASSIGN(exp, OP(guard_clauses_to_cond, REG(exp)))
+    RESTORE(continu)
+    GOTO(LABEL(eval_dispatch))
+
+MAKE_LABEL(guard_unwind_after)
+    SAVE(handlers)
+    ASSIGN(proc, OP(winder_after, REG(winders)))
+    ASSIGN(winders, OP(cdr, REG(winders)))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(guard_unwind_loop))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(ctl_with_exception_handler)
+    SAVE(handlers)
+    ASSIGN(val, OP(car, REG(argl)))
+    SAVE(val)
+    ASSIGN(handlers, OP(top_frame_index, THREAD))
+    ASSIGN(proc, OP(cadr, REG(argl)))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(weh_done))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(weh_done)
+    RESTORE(unev)
+    RESTORE(handlers)
+    RESTORE(continu)
+    GOTO(REG(continu))
+
+MAKE_LABEL(ctl_raise)
+    ASSIGN(val, OP(car, REG(argl)))
+    GOTO(LABEL(signal_raise))
+
+MAKE_LABEL(ctl_error)
+    ASSIGN(val, OP(mk_error_object, OP(car, REG(argl)), OP(cdr, REG(argl)), error_kind_general))
+    GOTO(LABEL(signal_raise))
+
+MAKE_LABEL(signal_raise)
+    TEST(OP(has_no_frame, REG(handlers)))
+    BRANCH(LABEL(raise_uncaught))
+    SAVE(handlers)
+    ASSIGN(continu, LABEL(raise_return))
+    GOTO(LABEL(signal_dispatch))
+
+MAKE_LABEL(ctl_raise_continuable)
+    ASSIGN(val, OP(car, REG(argl)))
+    TEST(OP(has_no_frame, REG(handlers)))
+    BRANCH(LABEL(raise_uncaught))
+    SAVE(handlers)
+    ASSIGN(continu, LABEL(raise_continuable_return))
+    GOTO(LABEL(signal_dispatch))
+
+MAKE_LABEL(signal_dispatch)
+    TEST(OP(is_guard_frame, THREAD, REG(handlers)))
+    BRANCH(LABEL(guard_unwind))
+    SAVE(continu)
+    ASSIGN(proc, OP(frame_procedure, THREAD, REG(handlers)))
+    ASSIGN(handlers, OP(frame_outer, THREAD, REG(handlers)))
+    ASSIGN(argl, OP(list, REG(val)))
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(raise_return)
+    RESTORE(unev)
+    ERROR("exception handler returned from non-continuable raise", REG(val))
+
+MAKE_LABEL(raise_continuable_return)
+    RESTORE(handlers)
+    RESTORE(continu)
+    GOTO(REG(continu))
+
+MAKE_LABEL(raise_uncaught)
+    PERFORM(OP(raise_uncaught, REG(val)))
+
+MAKE_LABEL(ctl_dynamic_wind)
+    SAVE(argl)
+    ASSIGN(proc, OP(car, REG(argl)))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(dw_before_done))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(dw_before_done)
+    RESTORE(argl)
+    ASSIGN(winders, OP(make_winder, OP(car, REG(argl)), OP(caddr, REG(argl)), REG(winders)))
+    ASSIGN(proc, OP(cadr, REG(argl)))
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(dw_thunk_done))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(dw_thunk_done)
+    ASSIGN(proc, OP(winder_after, REG(winders)))
+    ASSIGN(winders, OP(cdr, REG(winders)))
+    SAVE(val)
+    SAVE(mvals)
+    ASSIGN(argl, OP(empty_arglist,))
+    ASSIGN(continu, LABEL(dw_after_done))
+    SAVE(continu)
+    GOTO(LABEL(apply_dispatch))
+
+MAKE_LABEL(dw_after_done)
+    RESTORE(mvals)
+    RESTORE(val)
+    RESTORE(continu)
+    GOTO(REG(continu))
+
 EXIT_INTERPRETER
+
+        } catch (const noldor_exception &e) {
+            if (has_frame(REG(handlers))) {
+                ASSIGN(val, OP(error_object_from_exception, e))
+                resume = LABEL(signal_raise);
+            } else if (current != &root) {
+                // an uncaught error ends a green thread, joiners see it raised
+                PERFORM(OP(scheduler_terminate, OP(current_thread,), OP(error_object_from_exception, e), true))
+                resume = LABEL(schedule);
+            } else {
+                throw;
+            }
+        } catch (const green_thread_park &park) {
+            PERFORM(OP(scheduler_block, OP(current_thread,), LABEL(primitive_apply)))
+            PERFORM(OP(scheduler_wait_fd, OP(current_thread,), park.fd, park.events))
+            resume = LABEL(schedule);
+        } catch (const continuation_jump &jump) {
+            if (jump.owner != THREAD.id)
+                throw;
+
+            ASSIGN(proc, jump.continuation)
+            ASSIGN(argl, jump.arguments)
+            resume = LABEL(continuation_apply);
+        }
+    }
 }
 
 value apply(value proc, dot_tag, value argl)
@@ -724,20 +2002,44 @@ value apply(value proc, dot_tag, value argl)
     if (is_primitive_procedure(proc))
         return apply_primitive_procedure(proc, argl);
 
-    check_type(is_compound_procedure, proc, "apply: unknown procedure type");
+    check_type(is_procedure, proc, "apply: unknown procedure type");
 
-    auto env = extend_environment(procedure_parameters(proc), argl,
-                                  procedure_environment(proc));
+    return interpret(LABEL_apply_entry, list(), list(), proc, argl);
+}
 
-    auto body = procedure_body(proc);
-    body = cons(SYMBOL_LITERAL(begin), body);
+value eval(value exp, value env)
+{
+    return interpret(LABEL_eval_dispatch, exp, env, list(), list());
+}
 
-    return interpret(body, env);
+value thread_start(value t)
+{
+    auto data = green_thread_data(t);
+
+    if (data->status != green_thread_new)
+        throw noldor::call_error("thread-start!: thread already started", t);
+
+    thread_t &thread = *data->thread;
+    thread.assign(reg::proc, data->thunk);
+    thread.assign(reg::argl, list());
+    thread.assign(reg::handlers, no_frame());
+    thread.assign(reg::winders, list());
+    thread.assign(reg::prompts, no_frame());
+    thread.assign(reg::continu, LABEL_thread_exit);
+    thread.save(reg::continu);
+
+    scheduler_make_runnable(t, LABEL_apply_dispatch);
+    return t;
 }
 
-value eval(value exp, value env)
+void register_control_procedures()
 {
-    return interpret(exp, env);
+#define REGISTER_CONTROL_PROCEDURE(LISP_NAME, LABEL_NAME) \
+    environment_define(environment_global(), \
+                       symbol(LISP_NAME), \
+                       mk_control_procedure(LISP_NAME, LABEL_##LABEL_NAME));
+    X_CONTROL_PROCEDURES(REGISTER_CONTROL_PROCEDURE)
+#undef REGISTER_CONTROL_PROCEDURE
 }
 
 } // namespace noldor
@@ -25,6 +25,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "noldor_impl.h"
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <thread>
 
 #if defined(__clang__)
 #elif defined(__GNUC__)
@@ -33,70 +38,1545 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 namespace noldor {
 
-static void gc_mark_recursive(value *val, void *data)
+// Marking never recurses: visitors only push what they find onto the mark
+// stack, and drain_mark_stack marks and visits until it is empty. Objects
+// popped off the stack wait a few steps in a small queue after their memory
+// is prefetched, so the cache miss overlaps with marking the ones before.
+constexpr size_t MARK_PREFETCH_DISTANCE = 8;
+
+// Full collections of a big heap mark and sweep on several threads. Every
+// marking thread drains a stack of its own, and when that runs deep while
+// another thread is out of work, moves half of it to its share, from which
+// the idle threads take. Marking ends once every thread is idle.
+constexpr size_t GC_PARALLEL_MIN_HEAP = 4 * 1024 * 1024;
+constexpr size_t MARK_SHARE_SIZE = 64;
+
+struct mark_share {
+    std::mutex mutex;
+    std::vector<value> values;
+};
+
+struct parallel_mark {
+    unsigned n_threads;
+    std::unique_ptr<mark_share[]> shares;
+    std::atomic<size_t> n_shared { 0 };
+    std::atomic<unsigned> n_idle { 0 };
+
+    explicit parallel_mark(unsigned n)
+        : n_threads(n), shares(new mark_share[n])
+    {}
+};
+
+struct mark_state {
+    uint32_t mark;
+    bool next = false;          // into next_mark_bits, see concurrent_marker
+    bool concurrent = false;    // alongside running mutators
+    bool full = false;
+    std::vector<value> stack;
+    size_t n_marked = 0;
+    std::vector<value> weak_symbols;    // reached by a full collection
+    const std::atomic<bool> *stop = nullptr;
+
+    parallel_mark *parallel = nullptr;
+    unsigned index = 0;         // of this thread's share
+
+    uint64_t *bits(cell_page *page) const
+    { return next ? page->next_mark_bits : page->mark_bits; }
+
+    uint32_t &flags(large_object *obj) const
+    { return next ? obj->next_gc_flags : obj->gc_flags; }
+};
+
+// fields are loaded atomically, see gc_store
+static void gc_mark(value *val, void *data)
+{
+    value child = value(__atomic_load_n(reinterpret_cast<uint64_t *>(val), __ATOMIC_ACQUIRE));
+
+    if (magic::is_cell(child) || magic::is_pointer(child))
+        static_cast<mark_state *>(data)->stack.push_back(child);
+}
+
+// returns false if the bit was set already; other marking threads may be setting bits in the same word
+static bool mark_bit(uint64_t *bits, uint32_t i, bool parallel)
+{
+    uint64_t bit = uint64_t(1) << (i % 64);
+
+    if (!parallel) {
+        if (bits[i / 64] & bit)
+            return false;
+
+        bits[i / 64] |= bit;
+        return true;
+    }
+
+    if (__atomic_load_n(&bits[i / 64], __ATOMIC_RELAXED) & bit)
+        return false;
+
+    return !(__atomic_fetch_or(&bits[i / 64], bit, __ATOMIC_RELAXED) & bit);
+}
+
+// returns the metaobject to visit the object with, or null if there is nothing left to do
+static metatype_t *mark_object(value val, mark_state &state)
+{
+    bool parallel = state.parallel != nullptr;
+
+    if (magic::is_cell(val)) {
+        void *cell = magic::get_cell(val);
+        cell_page *page = cell_page::of(cell);
+
+        if (!mark_bit(state.bits(page), page->index_of(cell), parallel))
+            return nullptr;
+
+        return page->metaobject;
+    }
+
+    auto header = static_cast<gc_header *>(magic::get_pointer(val));
+
+    // immortal, and possibly being marked by another isolate right now
+    if (header->metaobject->flags & typeflags_static) {
+        if (state.full && magic::has_type_tag(val, type_tag_symbol) && is_weak_symbol(val))
+            state.weak_symbols.push_back(val);
+
+        return nullptr;
+    }
+
+    if (header->large) {
+        uint32_t &flags = state.flags(large_object::of(header));
+
+        if (flags == state.mark)
+            return nullptr;
+
+        if (!parallel)
+            flags = state.mark;
+        else if (__atomic_exchange_n(&flags, state.mark, __ATOMIC_RELAXED) == state.mark)
+            return nullptr;
+    } else {
+        cell_page *page = cell_page::of(header);
+
+        if (!mark_bit(state.bits(page), page->index_of(header), parallel))
+            return nullptr;
+    }
+
+    return header->metaobject;
+}
+
+static void share_work(mark_state &state)
+{
+    parallel_mark &parallel = *state.parallel;
+    mark_share &share = parallel.shares[state.index];
+    std::lock_guard<std::mutex> lock(share.mutex);
+
+    if (!share.values.empty())
+        return;
+
+    size_t n = state.stack.size() / 2;
+    share.values.assign(state.stack.end() - ptrdiff_t(n), state.stack.end());
+    state.stack.erase(state.stack.end() - ptrdiff_t(n), state.stack.end());
+    parallel.n_shared.fetch_add(1);
+}
+
+// returns false once every marking thread is out of work
+static bool take_work(mark_state &state)
+{
+    parallel_mark &parallel = *state.parallel;
+    bool idle = false;
+
+    for (;;) {
+        for (unsigned i = 0; i < parallel.n_threads && parallel.n_shared.load(); ++i) {
+            mark_share &share = parallel.shares[(state.index + i) % parallel.n_threads];
+            std::lock_guard<std::mutex> lock(share.mutex);
+
+            if (share.values.empty())
+                continue;
+
+            // only busy threads fill their shares, so this one is not idle yet
+            if (idle)
+                parallel.n_idle.fetch_sub(1);
+
+            state.stack.swap(share.values);
+            parallel.n_shared.fetch_sub(1);
+            return true;
+        }
+
+        if (!idle) {
+            idle = true;
+            parallel.n_idle.fetch_add(1);
+        } else if (parallel.n_idle.load() == parallel.n_threads) {
+            return false;
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+static void drain_mark_stack(mark_state &state)
+{
+    value queue[MARK_PREFETCH_DISTANCE] = {
+        uint64_t(0), uint64_t(0), uint64_t(0), uint64_t(0),
+        uint64_t(0), uint64_t(0), uint64_t(0), uint64_t(0)
+    };
+
+    size_t head = 0;
+    size_t n_queued = 0;
+
+    for (;;) {
+        while (n_queued < MARK_PREFETCH_DISTANCE && !state.stack.empty()) {
+            value val = state.stack.back();
+            state.stack.pop_back();
+
+            __builtin_prefetch(magic::is_cell(val) ? magic::get_cell(val) : magic::get_pointer(val));
+
+            queue[(head + n_queued) % MARK_PREFETCH_DISTANCE] = val;
+            n_queued++;
+        }
+
+        if (n_queued == 0) {
+            if (state.parallel && take_work(state))
+                continue;
+
+            return;
+        }
+
+        // hand what is left back to the stack for whoever finishes the job
+        if (state.stop && state.stop->load(std::memory_order_relaxed)) {
+            for (; n_queued; n_queued--, head = (head + 1) % MARK_PREFETCH_DISTANCE)
+                state.stack.push_back(queue[head]);
+
+            return;
+        }
+
+        value val = queue[head];
+        head = (head + 1) % MARK_PREFETCH_DISTANCE;
+        n_queued--;
+
+        metatype_t *metaobject = mark_object(val, state);
+
+        if (!metaobject)
+            continue;
+
+        state.n_marked++;
+
+        if (!metaobject->gc_visit)
+            continue;
+
+        // their insides change without write barriers, the final pause visits them
+        if (state.concurrent && (metaobject->flags & typeflags_remembered))
+            continue;
+
+        metaobject->gc_visit(val, gc_mark, &state);
+
+        if (state.parallel && state.stack.size() >= 2 * MARK_SHARE_SIZE &&
+            state.parallel->n_idle.load(std::memory_order_relaxed))
+            share_work(state);
+    }
+}
+
+static unsigned gc_thread_count()
+{
+    unsigned n = globals::gc_status_info()->n_threads.load();
+    return n ? n : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// runs fn(0) here and fn(1) to fn(n_threads - 1) on threads of their own
+template <typename Fn>
+static void run_on_threads(unsigned n_threads, Fn &&fn)
+{
+    isolate_t *isolate = globals::isolate();
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 1; i < n_threads; ++i) {
+        threads.emplace_back([isolate, &fn, i] {
+            globals::set_isolate(isolate);
+            fn(i);
+        });
+    }
+
+    fn(0);
+
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+// marks from the values on state's stack
+static void drain_in_parallel(mark_state &state, unsigned n_threads)
+{
+    parallel_mark parallel(n_threads);
+    std::vector<mark_state> states(n_threads);
+
+    for (unsigned i = 0; i < n_threads; ++i) {
+        states[i].mark = state.mark;
+        states[i].next = state.next;
+        states[i].full = state.full;
+        states[i].parallel = &parallel;
+        states[i].index = i;
+    }
+
+    for (size_t i = 0; i < state.stack.size(); ++i)
+        states[i % n_threads].stack.push_back(state.stack[i]);
+
+    state.stack.clear();
+
+    run_on_threads(n_threads, [&states] (unsigned i) {
+        drain_mark_stack(states[i]);
+    });
+
+    for (mark_state &done : states) {
+        state.n_marked += done.n_marked;
+        state.weak_symbols.insert(state.weak_symbols.end(), done.weak_symbols.begin(), done.weak_symbols.end());
+    }
+}
+
+static value cell_value(const cell_page &page, uint32_t index, metatype_t **metaobject)
+{
+    void *cell = page.cell_at(index);
+
+    if (page.metaobject) {
+        *metaobject = page.metaobject;
+        return magic::from_cell(cell, page.metaobject->tag);
+    }
+
+    auto header = static_cast<gc_header *>(cell);
+    *metaobject = header->metaobject;
+    return magic::from_pointer(header, header->metaobject->tag);
+}
+
+static void destroy_cell(cell_page &page, uint32_t index)
+{
+    metatype_t *metaobject = nullptr;
+    value obj = cell_value(page, index, &metaobject);
+
+    if (metaobject->destruct)
+        metaobject->destruct(obj);
+}
+
+static void remember_cell(void *cell, bool marking)
+{
+    cell_page *page = cell_page::of(cell);
+    uint32_t index = page->index_of(cell);
+
+    // young cells are traced anyway, unless the concurrent marker has been past them
+    if (!marking && !cell_page::test_bit(page->mark_bits, index))
+        return;
+
+    auto &word = page->remembered_bits[index / 64];
+    uint64_t bit = uint64_t(1) << (index % 64);
+
+    if (word.load(std::memory_order_relaxed) & bit)
+        return;
+
+    word.fetch_or(bit, std::memory_order_relaxed);
+    page->has_remembered.store(true, std::memory_order_relaxed);
+}
+
+void gc_write_barrier(value obj)
+{
+    if (!magic::is_cell(obj) && !magic::is_pointer(obj))
+        return;
+
+    bool marking = globals::isolate()->marking.load(std::memory_order_relaxed);
+
+    if (magic::is_cell(obj)) {
+        remember_cell(magic::get_cell(obj), marking);
+        return;
+    }
+
+    auto header = static_cast<gc_header *>(magic::get_pointer(obj));
+
+    if (header->metaobject->flags & typeflags_static)
+        return;
+
+    if (!header->large) {
+        remember_cell(header, marking);
+        return;
+    }
+
+    large_object *large = large_object::of(header);
+
+    if ((marking || large->gc_flags) && !large->remembered.load(std::memory_order_relaxed))
+        large->remembered.store(true, std::memory_order_relaxed);
+}
+
+// pins are counted per page, objects that never move need none
+static cell_page *pin_page(value obj)
+{
+    if (magic::is_cell(obj))
+        return cell_page::of(magic::get_cell(obj));
+
+    if (!magic::is_pointer(obj))
+        return nullptr;
+
+    auto header = static_cast<gc_header *>(magic::get_pointer(obj));
+
+    if (header->large || (header->metaobject->flags & typeflags_static))
+        return nullptr;
+
+    return cell_page::of(header);
+}
+
+void gc_pin(value obj)
+{
+    if (cell_page *page = pin_page(obj))
+        page->n_pinned.fetch_add(1);
+}
+
+void gc_unpin(value obj)
+{
+    if (cell_page *page = pin_page(obj))
+        page->n_pinned.fetch_sub(1);
+}
+
+// Traces the children of the remembered old objects when trace is set, then
+// forgets them all but those of typeflags_remembered types.
+static void scan_remembered(list_t *cell_spaces, list_t *allocations, bool trace, mark_state &state)
+{
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(cell_spaces, cell_space, gc_spaces)) {
+        for (cell_page &page : INTRUSIVE_LIST_LOOP(&space.pages, cell_page, gc_pages)) {
+            if (!page.has_remembered.load(std::memory_order_relaxed))
+                continue;
+
+            bool kept = false;
+
+            for (uint32_t w = 0; w < CELL_BITMAP_WORDS; ++w) {
+                uint64_t bits = page.remembered_bits[w].load(std::memory_order_relaxed);
+                uint64_t keep = 0;
+
+                for (; bits; bits &= bits - 1) {
+                    uint32_t index = w * 64 + uint32_t(__builtin_ctzll(bits));
+                    metatype_t *metaobject = nullptr;
+                    value obj = cell_value(page, index, &metaobject);
+
+                    if (trace && metaobject->gc_visit && cell_page::test_bit(state.bits(&page), index))
+                        metaobject->gc_visit(obj, gc_mark, &state);
+
+                    if (metaobject->flags & typeflags_remembered)
+                        keep |= bits & -bits;
+                }
+
+                page.remembered_bits[w].store(keep, std::memory_order_relaxed);
+                kept = kept || keep;
+            }
+
+            page.has_remembered.store(kept, std::memory_order_relaxed);
+        }
+    }
+
+    for (large_object &large : INTRUSIVE_LIST_LOOP(allocations, large_object, gc_objects)) {
+        if (!large.remembered.load(std::memory_order_relaxed))
+            continue;
+
+        metatype_t *metaobject = large.header.metaobject;
+
+        if (trace && metaobject->gc_visit && state.flags(&large))
+            metaobject->gc_visit(magic::from_pointer(&large.header, metaobject->tag), gc_mark, &state);
+
+        if (!(metaobject->flags & typeflags_remembered))
+            large.remembered.store(false, std::memory_order_relaxed);
+    }
+}
+
+// Sweeping is lazy. A collection only counts the dead cells of each page,
+// which is a few bitmap words, and queues the page on its space's unswept
+// list. The dead cells are destroyed and the page's free list rebuilt when an
+// allocating thread next needs a page from that space, or by an explicit
+// (garbage-collect). Pages held by an allocating thread are swept at once.
+static uint32_t count_dead(const cell_page &page)
+{
+    uint32_t n_words = (page.n_bumped + 63) / 64;
+    uint32_t n_dead = 0;
+
+    for (uint32_t w = 0; w < n_words; ++w)
+        n_dead += uint32_t(__builtin_popcountll(page.alloc_bits[w] & ~page.mark_bits[w]));
+
+    return n_dead;
+}
+
+static void rebuild_free_list(cell_page &page)
+{
+    page.free_list = nullptr;
+
+    for (uint32_t i = page.n_bumped; i-- > 0;) {
+        if (cell_page::test_bit(page.alloc_bits, i))
+            continue;
+
+        void *cell = page.cell_at(i);
+        *static_cast<void **>(cell) = page.free_list;
+        page.free_list = cell;
+    }
+}
+
+// frees the allocated and unmarked cells, a word of the bitmaps at a time
+static void sweep_page(cell_page &page)
+{
+    uint32_t n_words = (page.n_bumped + 63) / 64;
+    uint32_t n_freed = 0;
+
+    for (uint32_t w = 0; w < n_words; ++w) {
+        uint64_t dead = page.alloc_bits[w] & ~page.mark_bits[w];
+
+        if (!dead)
+            continue;
+
+        for (uint64_t bits = dead; bits; bits &= bits - 1)
+            destroy_cell(page, w * 64 + uint32_t(__builtin_ctzll(bits)));
+
+        page.alloc_bits[w] &= ~dead;
+        page.remembered_bits[w].fetch_and(~dead, std::memory_order_relaxed);
+        n_freed += uint32_t(__builtin_popcountll(dead));
+    }
+
+    page.n_live -= n_freed;
+    page.n_unswept = 0;
+
+    if (n_freed)
+        rebuild_free_list(page);
+}
+
+static void free_page(cell_page &page)
+{
+    list_remove(&page.gc_pages);
+    page.~cell_page();
+    free(&page);
+}
+
+// returns the bytes that died since the last collection
+static size_t queue_sweep(cell_space &space)
+{
+    auto *gc_status = globals::gc_status_info();
+
+    size_t n_newly_dead = 0;
+
+    space.available.clear();
+    space.unswept.clear();
+
+    for (cell_page &page : INTRUSIVE_LIST_LOOP(&space.pages, cell_page, gc_pages)) {
+        // dead cells still unswept were counted by an earlier collection
+        uint32_t n_dead = count_dead(page);
+        n_newly_dead += n_dead - page.n_unswept;
+        page.n_unswept = n_dead;
+
+        if (page.claimed) {
+            if (n_dead)
+                sweep_page(page);
+        } else if (page.n_live == 0) {
+            free_page(page);
+        } else if (n_dead) {
+            space.unswept.push_back(&page);
+        } else if (page.has_room()) {
+            space.available.push_back(&page);
+        }
+    }
+
+    gc_status->n_objects_allocated -= n_newly_dead;
+    return n_newly_dead * space.cell_size;
+}
+
+// Sweeps every page left unswept, in as many page ranges as there are
+// threads. A thread's destructors give back out-of-line storage in one go.
+static thread_local ptrdiff_t *external_batch = nullptr;
+
+static void finish_sweep(unsigned n_threads)
+{
+    std::vector<cell_page *> pages;
+
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(globals::cell_spaces(), cell_space, gc_spaces)) {
+        pages.insert(pages.end(), space.unswept.begin(), space.unswept.end());
+        space.unswept.clear();
+    }
+
+    n_threads = unsigned(std::min<size_t>(n_threads, (pages.size() + 15) / 16));
+
+    if (n_threads > 1) {
+        run_on_threads(n_threads, [&pages, n_threads] (unsigned i) {
+            ptrdiff_t n_external = 0;
+            external_batch = &n_external;
+
+            for (size_t p = pages.size() * i / n_threads; p < pages.size() * (i + 1) / n_threads; ++p)
+                sweep_page(*pages[p]);
+
+            external_batch = nullptr;
+            gc_account_external(n_external);
+        });
+    } else {
+        for (cell_page *page : pages)
+            sweep_page(*page);
+    }
+
+    for (cell_page *page : pages) {
+        if (page->n_live == 0)
+            free_page(*page);
+        else if (page->has_room())
+            page->space->available.push_back(page);
+    }
+}
+
+static void request_collection(struct gc_status_info *gc_status, size_t n_bytes_allocated)
+{
+    if (n_bytes_allocated > gc_status->threshold.load(std::memory_order_relaxed))
+        globals::isolate()->collect_requested.store(true, std::memory_order_relaxed);
+}
+
+void gc_account_external(ptrdiff_t n_bytes)
+{
+    if (external_batch) {
+        *external_batch += n_bytes;
+        return;
+    }
+
+    auto *gc_status = globals::gc_status_info();
+    size_t total = gc_status->n_bytes_allocated.fetch_add(size_t(n_bytes), std::memory_order_relaxed);
+
+    if (n_bytes > 0)
+        request_collection(gc_status, total + size_t(n_bytes));
+}
+
+// Each thread pushes its scopes onto a list of its own, which is registered
+// with the isolate the first time and walked only with the world stopped,
+// so pushing and popping a scope takes no lock.
+struct thread_scopes {
+    list_t scopes;
+    list_t gc_threads;
+    isolate_t *isolate = nullptr;
+
+    ~thread_scopes()
+    {
+        if (!isolate)
+            return;
+
+        std::lock_guard<std::mutex> lock(isolate->heap_mutex);
+        list_remove(&gc_threads);
+    }
+};
+
+static thread_local thread_scopes current_scopes;
+
+static list_t *scopes_of_thread()
+{
+    thread_scopes &ts = current_scopes;
+
+    if (!ts.isolate) {
+        ts.isolate = globals::isolate();
+
+        std::lock_guard<std::mutex> lock(ts.isolate->heap_mutex);
+        list_insert(&ts.isolate->thread_scopes, &ts.gc_threads);
+    }
+
+    return &ts.scopes;
+}
+
+static void visit_roots(gc_visit_fn_t visitor, void *data)
+{
+    for (thread_scopes &ts : INTRUSIVE_LIST_LOOP(globals::thread_scopes(), thread_scopes, gc_threads)) {
+        for (scope &sc : INTRUSIVE_LIST_LOOP(&ts.scopes, scope, gc_scopes))
+            sc.visit(visitor, data);
+    }
+
+    isolate_t *isolate = globals::isolate();
+    visitor(&isolate->global_environment, data);
+    visitor(&isolate->interaction_environment, data);
+
+    for (gc_finalizer &f : isolate->finalizers)
+        visitor(&f.proc, data);
+
+    for (gc_finalizer &f : isolate->finalizing) {
+        visitor(&f.obj, data);
+        visitor(&f.proc, data);
+    }
+}
+
+void gc_register_weak(value obj)
+{
+    std::lock_guard<std::mutex> lock(globals::heap_mutex());
+    globals::isolate()->weak_objects.push_back(obj);
+}
+
+void gc_register_finalizer(value obj, void (*native)(value obj))
+{
+    std::lock_guard<std::mutex> lock(globals::heap_mutex());
+    globals::isolate()->finalizers.push_back(gc_finalizer { obj, list(), native });
+}
+
+// runs what the last collection found dead, once the world is going again;
+// each one stays in finalizing, where visit_roots sees it, until it is taken
+// to run, as a finalizer may block and let another thread collect
+static void run_finalizers()
+{
+    isolate_t *isolate = globals::isolate();
+
+    for (;;) {
+        value obj = list();
+        value proc = list();
+        void (*native)(value obj) = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(globals::heap_mutex());
+
+            if (isolate->finalizing.empty())
+                return;
+
+            gc_finalizer &f = isolate->finalizing.front();
+            obj = f.obj;
+            proc = f.proc;
+            native = f.native;
+            isolate->finalizing.erase(isolate->finalizing.begin());
+        }
+
+        basic_scope roots { &obj, &proc };
+
+        if (native)
+            native(obj);
+        else
+            make_future(proc, {}, list(obj));
+    }
+}
+
+// The weak references of a collection are settled once marking is done.
+// A weak symbol counts as marked unless a full collection missed it.
+struct weak_pass {
+    const mark_state &state;
+    std::unordered_set<uint64_t> symbols;
+};
+
+static bool is_marked(value val, void *data)
+{
+    auto &pass = *static_cast<weak_pass *>(data);
+    const mark_state &state = pass.state;
+
+    if (magic::is_cell(val)) {
+        void *cell = magic::get_cell(val);
+        cell_page *page = cell_page::of(cell);
+        return cell_page::test_bit(state.bits(page), page->index_of(cell));
+    }
+
+    if (!magic::is_pointer(val))
+        return true;
+
+    auto header = static_cast<gc_header *>(magic::get_pointer(val));
+
+    if (header->metaobject->flags & typeflags_static)
+        return !state.full || !magic::has_type_tag(val, type_tag_symbol) || !is_weak_symbol(val) || pass.symbols.count(val);
+
+    if (header->large)
+        return state.flags(large_object::of(header)) != 0;
+
+    cell_page *page = cell_page::of(header);
+    return cell_page::test_bit(state.bits(page), page->index_of(header));
+}
+
+// Marks what the live ephemerons keep, brings back what died with a
+// finalizer or in a guardian along with what that keeps, then breaks the
+// references to everything left unmarked.
+static void settle_weak(mark_state &state)
+{
+    isolate_t *isolate = globals::isolate();
+    std::vector<value> &objects = isolate->weak_objects;
+    weak_pass pass { state, {} };
+    size_t n_seen = 0;
+
+    auto trace_ephemerons = [&] {
+        for (;;) {
+            pass.symbols.insert(state.weak_symbols.begin() + ptrdiff_t(n_seen), state.weak_symbols.end());
+            n_seen = state.weak_symbols.size();
+
+            size_t n_marked = state.n_marked;
+
+            for (value obj : objects) {
+                if (is_marked(obj, &pass))
+                    weak_trace(obj, is_marked, &pass, gc_mark, &state);
+            }
+
+            drain_mark_stack(state);
+
+            if (state.n_marked == n_marked)
+                break;
+        }
+
+        pass.symbols.insert(state.weak_symbols.begin() + ptrdiff_t(n_seen), state.weak_symbols.end());
+        n_seen = state.weak_symbols.size();
+    };
+
+    trace_ephemerons();
+
+    size_t n_waiting = 0;
+
+    for (gc_finalizer &f : isolate->finalizers) {
+        if (is_marked(f.obj, &pass)) {
+            isolate->finalizers[n_waiting++] = f;
+        } else {
+            isolate->finalizing.push_back(f);
+            gc_mark(&f.obj, &state);
+        }
+    }
+
+    isolate->finalizers.erase(isolate->finalizers.begin() + ptrdiff_t(n_waiting), isolate->finalizers.end());
+
+    for (value obj : objects) {
+        if (is_marked(obj, &pass))
+            weak_resurrect(obj, is_marked, &pass, gc_mark, &state);
+    }
+
+    trace_ephemerons();
+    state.weak_symbols.clear();
+
+    size_t n_kept = 0;
+
+    for (value obj : objects) {
+        if (!is_marked(obj, &pass))
+            continue;
+
+        weak_clear(obj, is_marked, &pass);
+        objects[n_kept++] = obj;
+    }
+
+    objects.erase(objects.begin() + ptrdiff_t(n_kept), objects.end());
+
+    if (state.full)
+        release_weak_symbols(isolate, &pass.symbols);
+}
+
+// frees the unmarked large objects and queues the cell pages for sweeping
+static size_t sweep(bool full)
+{
+    list_t *allocations = globals::allocations();
+    list_t *cell_spaces = globals::cell_spaces();
+
+    auto *gc_status = globals::gc_status_info();
+
+    size_t n_bytes_freed = 0;
+
+    for (large_object &obj : INTRUSIVE_LIST_LOOP(allocations, large_object, gc_objects)) {
+        if (obj.gc_flags == 0) {
+            metatype_t *metaobject = obj.header.metaobject;
+
+            n_bytes_freed += obj.n_bytes;
+
+            list_remove(&obj.gc_objects);
+
+            if (metaobject->destruct)
+                metaobject->destruct(magic::from_pointer(&obj.header, metaobject->tag));
+
+            free(&obj);
+
+            gc_status->n_objects_allocated -= 1;
+        }
+    }
+
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(cell_spaces, cell_space, gc_spaces)) {
+        if (space.metaobject && (space.metaobject->flags & typeflags_static))
+            continue;
+
+        n_bytes_freed += queue_sweep(space);
+    }
+
+    size_t live = gc_status->n_bytes_allocated -= n_bytes_freed;
+
+    if (full) {
+        size_t threshold = size_t(double(live) * gc_status->growth_factor.load());
+        gc_status->full_threshold = std::max(threshold, GC_MIN_THRESHOLD);
+    }
+
+    gc_status->threshold = live + GC_NURSERY_SIZE;
+    globals::isolate()->collect_requested = false;
+
+    return n_bytes_freed;
+}
+
+// the world is stopped and the heap locked
+static size_t collect(bool full)
+{
+    list_t *allocations = globals::allocations();
+    list_t *cell_spaces = globals::cell_spaces();
+
+    if (full) {
+        for (large_object &obj : INTRUSIVE_LIST_LOOP(allocations, large_object, gc_objects))
+            obj.gc_flags = 0;
+
+        for (cell_space &space : INTRUSIVE_LIST_LOOP(cell_spaces, cell_space, gc_spaces))
+            for (cell_page &page : INTRUSIVE_LIST_LOOP(&space.pages, cell_page, gc_pages))
+                std::fill(std::begin(page.mark_bits), std::end(page.mark_bits), 0);
+    }
+
+    mark_state state;
+    state.mark = 1;
+    state.full = full;
+
+    visit_roots(gc_mark, &state);
+    scan_remembered(cell_spaces, allocations, !full, state);
+
+    unsigned n_threads = gc_thread_count();
+
+    if (full && n_threads > 1 && globals::gc_status_info()->n_bytes_allocated.load() >= GC_PARALLEL_MIN_HEAP)
+        drain_in_parallel(state, n_threads);
+    else
+        drain_mark_stack(state);
+
+    settle_weak(state);
+    return sweep(full);
+}
+
+// The marker thread only reads the heap and writes the next mark bits.
+// Objects whose insides change without a write barrier are marked but not
+// visited by it; they are permanently remembered, and traced at the pause.
+// It reads fields the mutators may be storing into, which is fine as long
+// as storing a word is atomic; a value it misses that way was stored with a
+// write barrier, so its holder is remembered and retraced at the pause.
+struct concurrent_marker {
+    mark_state state;
+    std::atomic<bool> stop { false };
+    std::thread thread;
+};
+
+static void start_concurrent_marking()
+{
+    isolate_t *isolate = globals::isolate();
+    auto *gc_status = globals::gc_status_info();
+
+    for (large_object &obj : INTRUSIVE_LIST_LOOP(globals::allocations(), large_object, gc_objects))
+        obj.next_gc_flags = 0;
+
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(globals::cell_spaces(), cell_space, gc_spaces))
+        for (cell_page &page : INTRUSIVE_LIST_LOOP(&space.pages, cell_page, gc_pages))
+            std::fill(std::begin(page.next_mark_bits), std::end(page.next_mark_bits), 0);
+
+    auto *marker = new concurrent_marker;
+    marker->state.mark = 1;
+    marker->state.next = true;
+    marker->state.concurrent = true;
+    marker->state.full = true;
+    marker->state.stop = &marker->stop;
+
+    visit_roots(gc_mark, &marker->state);
+
+    // no minor collections until the pause, which comes when the marker is done
+    // or the nursery fills up, whichever is first
+    gc_status->threshold = gc_status->n_bytes_allocated.load() + GC_NURSERY_SIZE;
+    isolate->collect_requested = false;
+    isolate->marking = true;
+    isolate->marker = marker;
+
+    marker->thread = std::thread([isolate, marker] {
+        globals::set_isolate(isolate);
+        drain_mark_stack(marker->state);
+
+        if (!marker->stop.load())
+            isolate->collect_requested = true;
+    });
+}
+
+static void stop_concurrent_marking(isolate_t *isolate)
+{
+    concurrent_marker *marker = isolate->marker;
+
+    marker->stop = true;
+    marker->thread.join();
+    isolate->marker = nullptr;
+    isolate->marking = false;
+}
+
+void finish_concurrent_marking()
+{
+    isolate_t *isolate = globals::isolate();
+
+    if (!isolate->marker)
+        return;
+
+    list_t *allocations = globals::allocations();
+    list_t *cell_spaces = globals::cell_spaces();
+
+    std::unique_ptr<concurrent_marker> marker(isolate->marker);
+    mark_state &state = marker->state;
+
+    stop_concurrent_marking(isolate);
+
+    state.concurrent = false;
+    state.stop = nullptr;
+
+    visit_roots(gc_mark, &state);
+    scan_remembered(cell_spaces, allocations, true, state);
+    drain_mark_stack(state);
+    settle_weak(state);
+
+    for (large_object &obj : INTRUSIVE_LIST_LOOP(allocations, large_object, gc_objects)) {
+        obj.gc_flags = obj.next_gc_flags;
+        obj.next_gc_flags = 0;
+    }
+
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(cell_spaces, cell_space, gc_spaces)) {
+        for (cell_page &page : INTRUSIVE_LIST_LOOP(&space.pages, cell_page, gc_pages)) {
+            std::copy(std::begin(page.next_mark_bits), std::end(page.next_mark_bits), page.mark_bits);
+            std::fill(std::begin(page.next_mark_bits), std::end(page.next_mark_bits), 0);
+        }
+    }
+
+    sweep(true);
+}
+
+// Compaction evacuates the sparse pages of each space into fresh ones and
+// frees them. It follows a full collection that swept every page, and
+// retraces the heap from the roots: the first reference found to a cell on
+// an evacuated page copies the cell, so a list comes out in consecutive
+// cells, and leaves the copy's value in the old cell for the references
+// found later. Only cells of movable types move; pages holding a pin or
+// claimed by an allocating thread are left alone.
+constexpr double COMPACTION_MAX_OCCUPANCY = 0.5;
+
+static cell_page *new_cell_page(cell_space *space);
+
+struct compaction {
+    std::vector<value> stack;
+    std::vector<cell_page *> targets;   // by space index
+};
+
+// returns whether it is worth evacuating the sparse pages of space
+static bool choose_evacuees(cell_space &space)
+{
+    if (space.metaobject && !(space.metaobject->flags & typeflags_movable))
+        return false;
+
+    std::vector<cell_page *> sparse;
+    size_t n_live = 0;
+    size_t n_cells = 0;
+
+    for (cell_page &page : INTRUSIVE_LIST_LOOP(&space.pages, cell_page, gc_pages)) {
+        if (page.claimed || page.n_pinned.load() || page.n_live >= page.n_cells * COMPACTION_MAX_OCCUPANCY)
+            continue;
+
+        sparse.push_back(&page);
+        n_live += page.n_live;
+        n_cells = page.n_cells;
+    }
+
+    // the survivors have to fit in fewer pages
+    if (sparse.size() < 2 || (n_live + n_cells - 1) / n_cells >= sparse.size())
+        return false;
+
+    for (cell_page *page : sparse)
+        page->evacuating = true;
+
+    return true;
+}
+
+static void *evacuation_target(compaction &c, cell_space *space)
+{
+    if (space->index >= c.targets.size())
+        c.targets.resize(space->index + 1, nullptr);
+
+    cell_page *&page = c.targets[space->index];
+
+    if (!page || !page->has_room())
+        page = new_cell_page(space);
+
+    return page->take();
+}
+
+static value evacuate_cell(compaction &c, cell_page *page, uint32_t index, metatype_t *metaobject)
+{
+    void *cell = page->cell_at(index);
+    void *copy = evacuation_target(c, page->space);
+    memcpy(copy, cell, page->cell_size);
+
+    cell_page *to = cell_page::of(copy);
+    uint32_t to_index = to->index_of(copy);
+    cell_page::set_bit(to->alloc_bits, to_index);
+    cell_page::set_bit(to->mark_bits, to_index);
+    cell_page::set_bit(to->next_mark_bits, to_index);
+    to->n_live += 1;
+
+    uint64_t bit = uint64_t(1) << (index % 64);
+
+    if (page->remembered_bits[index / 64].fetch_and(~bit) & bit) {
+        to->remembered_bits[to_index / 64].fetch_or(uint64_t(1) << (to_index % 64));
+        to->has_remembered = true;
+    }
+
+    cell_page::clear_bit(page->alloc_bits, index);
+    cell_page::clear_bit(page->mark_bits, index);
+    page->n_live -= 1;
+
+    value moved = page->metaobject ? magic::from_cell(copy, metaobject->tag)
+                                   : magic::from_pointer(copy, metaobject->tag);
+
+    *static_cast<uint64_t *>(cell) = moved;
+    return moved;
+}
+
+// the visitor of the compacting trace, next_mark_bits and next_gc_flags tell what it has been through
+static void evacuate(value *val, void *data)
 {
-    if (!magic::is_pointer(*val))
+    auto &c = *static_cast<compaction *>(data);
+    cell_page *page = nullptr;
+    metatype_t *metaobject = nullptr;
+    void *cell = nullptr;
+
+    if (magic::is_cell(*val)) {
+        cell = magic::get_cell(*val);
+        page = cell_page::of(cell);
+        metaobject = page->metaobject;
+    } else if (magic::is_pointer(*val)) {
+        auto header = static_cast<gc_header *>(magic::get_pointer(*val));
+        metaobject = header->metaobject;
+
+        if (header->large) {
+            large_object *obj = large_object::of(header);
+
+            if (!(metaobject->flags & typeflags_static) && !obj->next_gc_flags) {
+                obj->next_gc_flags = 1;
+                c.stack.push_back(*val);
+            }
+
+            return;
+        }
+
+        cell = header;
+        page = cell_page::of(header);
+    } else {
         return;
+    }
+
+    uint32_t index = page->index_of(cell);
 
-    auto header = static_cast<gc_header *>(magic::get_pointer(*val));
+    if (page->evacuating) {
+        // gone already, the old cell holds the copy
+        if (!cell_page::test_bit(page->alloc_bits, index)) {
+            *val = value(*static_cast<uint64_t *>(cell));
+            return;
+        }
 
-    const uint32_t mark = *reinterpret_cast<uint32_t *>(data);
+        if (metaobject->flags & typeflags_movable) {
+            *val = evacuate_cell(c, page, index, metaobject);
+            c.stack.push_back(*val);
+            return;
+        }
+    }
 
-    if (header->gc_flags == mark)
+    if (metaobject->flags & typeflags_static)
         return;
 
-    header->gc_flags = mark;
+    if (mark_bit(page->next_mark_bits, index, false))
+        c.stack.push_back(*val);
+}
+
+static metatype_t *metaobject_of(value val)
+{
+    if (magic::is_cell(val))
+        return cell_page::of(magic::get_cell(val))->metaobject;
+
+    return static_cast<gc_header *>(magic::get_pointer(val))->metaobject;
+}
+
+// the world is stopped, the heap locked and swept, and nothing is being marked; returns the bytes of pages freed
+static size_t compact()
+{
+    list_t *cell_spaces = globals::cell_spaces();
+    bool any = false;
+
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(cell_spaces, cell_space, gc_spaces))
+        any = choose_evacuees(space) || any;
+
+    if (!any)
+        return 0;
+
+    compaction c;
+
+    auto trace = [&c] {
+        while (!c.stack.empty()) {
+            value val = c.stack.back();
+            c.stack.pop_back();
+
+            metatype_t *metaobject = metaobject_of(val);
+
+            if (metaobject->gc_visit)
+                metaobject->gc_visit(val, evacuate, &c);
+        }
+    };
+
+    visit_roots(evacuate, &c);
+    trace();
+
+    // what the weak objects hold is all alive right after a full collection
+    for (value obj : globals::isolate()->weak_objects)
+        weak_visit(obj, evacuate, &c);
+
+    for (gc_finalizer &f : globals::isolate()->finalizers)
+        evacuate(&f.obj, &c);
+
+    trace();
+
+    for (large_object &obj : INTRUSIVE_LIST_LOOP(globals::allocations(), large_object, gc_objects))
+        obj.next_gc_flags = 0;
+
+    size_t n_bytes_freed = 0;
+
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(cell_spaces, cell_space, gc_spaces)) {
+        space.available.clear();
+
+        for (cell_page &page : INTRUSIVE_LIST_LOOP(&space.pages, cell_page, gc_pages)) {
+            std::fill(std::begin(page.next_mark_bits), std::end(page.next_mark_bits), 0);
+
+            if (page.evacuating) {
+                page.evacuating = false;
+
+                if (page.n_live == 0) {
+                    free_page(page);
+                    n_bytes_freed += CELL_PAGE_SIZE;
+                    continue;
+                }
+
+                rebuild_free_list(page);
+            }
+
+            if (!page.claimed && page.has_room())
+                space.available.push_back(&page);
+        }
+    }
+
+    return n_bytes_freed;
+}
+
+int run_compaction()
+{
+    size_t n_bytes_freed = 0;
+
+    {
+        world_stop stop;
+        std::lock_guard<std::mutex> lock(globals::heap_mutex());
+
+        finish_concurrent_marking();
 
-    if (header->metaobject->gc_visit)
-        header->metaobject->gc_visit(*val, gc_mark_recursive, data);
+        collect(true);
+        finish_sweep(gc_thread_count());
+
+        n_bytes_freed = compact();
+    }
+
+    run_finalizers();
+    return int(n_bytes_freed);
 }
 
 int run_gc()
 {
-    list_t *allocations = globals::allocations();
-    list_t *scopes = globals::scopes();
+    size_t n_bytes_freed = 0;
+
+    {
+        world_stop stop;
+        std::lock_guard<std::mutex> lock(globals::heap_mutex());
+
+        finish_concurrent_marking();
+
+        n_bytes_freed = collect(true);
+        finish_sweep(gc_thread_count());
+    }
+
+    run_finalizers();
+    return int(n_bytes_freed);
+}
+
+// the world is stopped
+static void collect_requested()
+{
+    isolate_t *isolate = globals::isolate();
 
-    uint32_t dead_mark = 0;
-    uint32_t live_mark = 1;
+    // another thread may have collected while we waited for the world
+    if (!isolate->collect_requested.load())
+        return;
 
-    for (gc_header &header : INTRUSIVE_LIST_LOOP(allocations, gc_header, gc_objects))
-        header.gc_flags = dead_mark;
+    std::lock_guard<std::mutex> lock(globals::heap_mutex());
 
-    for (scope &sc : INTRUSIVE_LIST_LOOP(scopes, scope, gc_scopes))
-        sc.visit(gc_mark_recursive, &live_mark);
+    if (isolate->marker) {
+        finish_concurrent_marking();
+        return;
+    }
 
     auto *gc_status = globals::gc_status_info();
+    bool full = gc_status->n_bytes_allocated.load() >= gc_status->full_threshold.load();
+
+    if (full && isolate->concurrent_marking.load()) {
+        start_concurrent_marking();
+        return;
+    }
 
-    int n_bytes_freed = 0;
+    collect(full);
 
-    for (gc_header &header : INTRUSIVE_LIST_LOOP(allocations, gc_header, gc_objects)) {
-        if (header.metaobject->flags & typeflags_static)
-            continue;
+    if (full && isolate->compaction.load()) {
+        finish_sweep(gc_thread_count());
+        compact();
+    }
+}
 
-        if (header.gc_flags == dead_mark) {
-            assert(header.metaobject);
+void collect_if_requested()
+{
+    {
+        world_stop stop;
+        collect_requested();
+    }
 
-            n_bytes_freed += header.alloc_size + header.data_offset;
+    run_finalizers();
+}
 
-            list_remove(&header.gc_objects);
+value gc_threads(dot_tag, value n)
+{
+    auto *gc_status = globals::gc_status_info();
 
-            if (header.metaobject->destruct)
-                header.metaobject->destruct(magic::from_pointer(&header));
+    if (!is_null(n)) {
+        check_type(is_int, car(n), "gc-threads: expected integer");
 
-            free(&header);
+        if (to_int(car(n)) < 0)
+            throw type_error("gc-threads: expected a count, or 0 for one per core", car(n));
 
-            gc_status->n_objects_allocated -= 1;
+        gc_status->n_threads = unsigned(to_int(car(n)));
+    }
+
+    return mk_int(int(gc_thread_count()));
+}
+
+value gc_compaction(dot_tag, value flag)
+{
+    isolate_t *isolate = globals::isolate();
+
+    if (!is_null(flag))
+        isolate->compaction = !is_false(car(flag));
+
+    return mk_bool(isolate->compaction.load());
+}
+
+value register_finalizer(value obj, value proc)
+{
+    check_type(is_procedure, proc, "register-finalizer!: expected procedure");
+
+    bool immortal = !magic::is_cell(obj) && !magic::is_pointer(obj);
+    immortal = immortal || ((metaobject_of(obj)->flags & typeflags_static) && !(is_symbol(obj) && is_weak_symbol(obj)));
+
+    if (!immortal) {
+        std::lock_guard<std::mutex> lock(globals::heap_mutex());
+        globals::isolate()->finalizers.push_back(gc_finalizer { obj, proc, nullptr });
+    }
+
+    return obj;
+}
+
+value gc_concurrent_marking(dot_tag, value flag)
+{
+    isolate_t *isolate = globals::isolate();
+
+    if (!is_null(flag))
+        isolate->concurrent_marking = !is_false(car(flag));
+
+    return mk_bool(isolate->concurrent_marking.load());
+}
+
+value gc_growth_factor(dot_tag, value factor)
+{
+    auto *gc_status = globals::gc_status_info();
+
+    if (!is_null(factor)) {
+        check_type(is_number, car(factor), "gc-growth-factor: expected number");
+
+        double d = is_int(car(factor)) ? to_int(car(factor)) : to_double(car(factor));
+
+        if (d < 1.0)
+            throw type_error("gc-growth-factor: expected at least 1", car(factor));
+
+        gc_status->growth_factor = d;
+    }
+
+    return mk_double(gc_status->growth_factor.load());
+}
+
+// Each OS thread allocates cells from pages it has claimed, one per space,
+// without taking any lock; only claiming a fresh page goes through the heap.
+// Allocation is counted locally as well and added to the isolate's totals
+// in batches, and before the thread lets the world stop.
+struct allocation_buffers {
+    cell_space *last_space = nullptr;
+    std::vector<cell_page *> pages;
+
+    size_t n_bytes_pending = 0;
+    size_t n_objects_pending = 0;
+
+    ~allocation_buffers()
+    {
+        flush_allocation_counts();
+
+        std::lock_guard<std::mutex> lock(globals::heap_mutex());
+
+        for (cell_page *page : pages) {
+            if (page)
+                release_page(page);
         }
     }
 
-    gc_status->n_bytes_allocated -= size_t(n_bytes_freed);
-    return n_bytes_freed;
+    static void release_page(cell_page *page)
+    {
+        page->claimed = false;
+
+        if (page->has_room())
+            page->space->available.push_back(page);
+    }
+};
+
+static allocation_buffers &local_buffers()
+{
+    static thread_local allocation_buffers buffers;
+    return buffers;
 }
 
-value allocate(metatype_t *metaobject, size_t size, size_t alignment)
+constexpr size_t ALLOCATION_BATCH_SIZE = 32 * 1024;
+
+void flush_allocation_counts()
 {
+    auto &buffers = local_buffers();
+
+    if (!buffers.n_bytes_pending)
+        return;
+
     auto *gc_status = globals::gc_status_info();
+    size_t n_bytes = gc_status->n_bytes_allocated.fetch_add(buffers.n_bytes_pending, std::memory_order_relaxed);
+    gc_status->n_objects_allocated.fetch_add(buffers.n_objects_pending, std::memory_order_relaxed);
+    request_collection(gc_status, n_bytes + buffers.n_bytes_pending);
+
+    buffers.n_bytes_pending = 0;
+    buffers.n_objects_pending = 0;
+}
+
+static cell_space *find_cell_space(metatype_t *metaobject, uint32_t cell_size)
+{
+    std::lock_guard<std::mutex> lock(globals::heap_mutex());
+
+    list_t *spaces = globals::cell_spaces();
+    uint32_t n_spaces = 0;
+
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(spaces, cell_space, gc_spaces)) {
+        if (space.metaobject == metaobject && space.cell_size == cell_size)
+            return &space;
+
+        n_spaces++;
+    }
+
+    auto space = new cell_space;
+    space->metaobject = metaobject;
+    space->cell_size = cell_size;
+    space->index = n_spaces;
+    list_insert(spaces, &space->gc_spaces);
+
+    return space;
+}
+
+static cell_page *new_cell_page(cell_space *space)
+{
+    void *mem = nullptr;
+
+    if (posix_memalign(&mem, CELL_PAGE_SIZE, CELL_PAGE_SIZE) != 0)
+        throw std::bad_alloc();
+
+    auto page = new (mem) cell_page;
+    size_t header_size = (sizeof(cell_page) + space->cell_size - 1) / space->cell_size * space->cell_size;
+
+    page->metaobject = space->metaobject;
+    page->space = space;
+    page->cell_size = space->cell_size;
+    page->n_cells = uint32_t((CELL_PAGE_SIZE - header_size) / space->cell_size);
+    page->cells = static_cast<char *>(mem) + header_size;
+
+    list_insert(&space->pages, &page->gc_pages);
+
+    return page;
+}
+
+static cell_page *claim_page(cell_space *space, cell_page *full)
+{
+    std::lock_guard<std::mutex> lock(globals::heap_mutex());
+
+    if (full)
+        allocation_buffers::release_page(full);
+
+    cell_page *page = nullptr;
+
+    while (!space->available.empty() && !page) {
+        page = space->available.back();
+        space->available.pop_back();
+
+        if (page->claimed || !page->has_room())
+            page = nullptr;
+    }
+
+    while (!space->unswept.empty() && !page) {
+        page = space->unswept.back();
+        space->unswept.pop_back();
+
+        sweep_page(*page);
+
+        if (!page->has_room())
+            page = nullptr;
+    }
+
+    if (!page)
+        page = new_cell_page(space);
+
+    page->claimed = true;
+    return page;
+}
+
+static void *take_cell(allocation_buffers &buffers, cell_space *space)
+{
+    if (space->index >= buffers.pages.size())
+        buffers.pages.resize(space->index + 1, nullptr);
+
+    cell_page *&page = buffers.pages[space->index];
+    void *cell = page ? page->take() : nullptr;
+
+    if (!cell) {
+        page = claim_page(space, page);
+        cell = page->take();
+    }
+
+    cell_page::set_bit(page->alloc_bits, page->index_of(cell));
+    page->n_live += 1;
+
+    buffers.n_bytes_pending += space->cell_size;
+    buffers.n_objects_pending += 1;
+
+    if (buffers.n_bytes_pending >= ALLOCATION_BATCH_SIZE)
+        flush_allocation_counts();
+
+    return cell;
+}
+
+value allocate_cell(metatype_t *metaobject, size_t size)
+{
+    assert(size > 0 && size <= CELL_PAGE_SIZE / 64);
+
+    auto &buffers = local_buffers();
+
+    uint32_t cell_size = uint32_t((size + CELL_ALIGNMENT - 1) / CELL_ALIGNMENT * CELL_ALIGNMENT);
+
+    // most spaces are looked up by the same few types over and over again
+    cell_space *space = buffers.last_space;
+
+    if (!space || space->metaobject != metaobject || space->cell_size != cell_size)
+        space = buffers.last_space = find_cell_space(metaobject, cell_size);
+
+    return magic::from_cell(take_cell(buffers, space), metaobject->tag);
+}
+
+static cell_space *object_space(size_t total_size)
+{
+    auto size_class = std::lower_bound(std::begin(OBJECT_SIZE_CLASSES), std::end(OBJECT_SIZE_CLASSES), total_size);
+
+    if (size_class == std::end(OBJECT_SIZE_CLASSES))
+        return nullptr;
+
+    auto &slot = globals::isolate()->object_spaces[size_class - std::begin(OBJECT_SIZE_CLASSES)];
+    cell_space *space = slot.load(std::memory_order_acquire);
+
+    if (!space) {
+        space = find_cell_space(nullptr, *size_class);
+        slot.store(space, std::memory_order_release);
+    }
+
+    return space;
+}
 
+value allocate(metatype_t *metaobject, size_t size, size_t alignment)
+{
     size_t header_size = sizeof(gc_header) - 1;
     size_t padding = 0;
 
@@ -105,8 +1585,44 @@ value allocate(metatype_t *metaobject, size_t size, size_t alignment)
 
     size_t total_size = header_size + padding + size;
 
-    auto *mem = static_cast<char *>(malloc(total_size));
-    auto header = new (mem) gc_header;
+    // static objects outlive the isolate's pages
+    bool is_static = (metaobject->flags & typeflags_static) != 0;
+    cell_space *space = is_static ? nullptr : object_space(total_size);
+
+    gc_header *header = nullptr;
+
+    if (space) {
+        header = new (take_cell(local_buffers(), space)) gc_header;
+
+        if (metaobject->flags & typeflags_remembered) {
+            cell_page *page = cell_page::of(header);
+            uint32_t index = page->index_of(header);
+
+            page->remembered_bits[index / 64].fetch_or(uint64_t(1) << (index % 64), std::memory_order_relaxed);
+            page->has_remembered.store(true, std::memory_order_relaxed);
+        }
+    } else {
+        size_t n_bytes = offsetof(large_object, header) + total_size;
+
+        auto obj = new (malloc(n_bytes)) large_object;
+        obj->n_bytes = n_bytes;
+
+        header = &obj->header;
+        header->large = true;
+        obj->remembered = (metaobject->flags & typeflags_remembered) != 0;
+
+        if (!is_static) {
+            auto *gc_status = globals::gc_status_info();
+
+            globals::register_allocation(obj);
+
+            size_t n_allocated = gc_status->n_bytes_allocated.fetch_add(n_bytes, std::memory_order_relaxed);
+            gc_status->n_objects_allocated.fetch_add(1, std::memory_order_relaxed);
+            request_collection(gc_status, n_allocated + n_bytes);
+        }
+    }
+
+    assert((reinterpret_cast<uintptr_t>(header) & type_tag_max) == 0);
 
     void *object = header->data;
     size_t object_space = padding + size;
@@ -121,39 +1637,120 @@ value allocate(metatype_t *metaobject, size_t size, size_t alignment)
     header->data_offset = uint8_t(offset);
     header->alloc_size = uint32_t(size);
 
-    globals::register_allocation(header);
+    return magic::from_pointer(header, metaobject->tag);
+}
+
+static isolate_t *main_isolate()
+{
+    // never torn down, static objects of every isolate may point into it
+    static isolate_t *isolate = new isolate_t;
+    return isolate;
+}
+
+static thread_local isolate_t *current_isolate = nullptr;
 
-    gc_status->n_bytes_allocated += total_size;
-    gc_status->n_objects_allocated += 1;
+isolate_t *globals::isolate()
+{
+    isolate_t *isolate = current_isolate;
+
+    if (!isolate)
+        isolate = current_isolate = main_isolate();
+
+    return isolate;
+}
 
-    return magic::from_pointer(mem);
+void globals::set_isolate(isolate_t *isolate)
+{
+    current_isolate = isolate;
 }
 
-list_t *globals::scopes()
+list_t *globals::thread_scopes()
 {
-    static list_t scopes;
-    return &scopes;
+    return &isolate()->thread_scopes;
 }
 
 list_t *globals::allocations()
 {
-    static list_t allocs;
-    return &allocs;
+    return &isolate()->allocations;
+}
+
+list_t *globals::cell_spaces()
+{
+    return &isolate()->cell_spaces;
 }
 
 struct gc_status_info *globals::gc_status_info()
 {
-    static struct gc_status_info info;
-    return &info;
+    return &isolate()->gc_status;
+}
+
+std::mutex &globals::heap_mutex()
+{
+    return isolate()->heap_mutex;
+}
+
+std::atomic<bool> &globals::stop_requested()
+{
+    return isolate()->stop_requested;
+}
+
+// the isolate's threads are gone, everything left on its heap is garbage
+isolate_t::~isolate_t()
+{
+    if (marker) {
+        std::unique_ptr<concurrent_marker> owned(marker);
+        stop_concurrent_marking(this);
+    }
+
+    for (large_object &obj : INTRUSIVE_LIST_LOOP(&allocations, large_object, gc_objects)) {
+        list_remove(&obj.gc_objects);
+
+        if (obj.header.metaobject->destruct)
+            obj.header.metaobject->destruct(magic::from_pointer(&obj.header, obj.header.metaobject->tag));
+
+        free(&obj);
+    }
+
+    release_weak_symbols(this, nullptr);
+
+    for (cell_space &space : INTRUSIVE_LIST_LOOP(&cell_spaces, cell_space, gc_spaces)) {
+        for (cell_page &page : INTRUSIVE_LIST_LOOP(&space.pages, cell_page, gc_pages)) {
+            for (uint32_t i = 0; i < page.n_bumped; ++i) {
+                if (cell_page::test_bit(page.alloc_bits, i))
+                    destroy_cell(page, i);
+            }
+
+            list_remove(&page.gc_pages);
+            page.~cell_page();
+            free(&page);
+        }
+
+        list_remove(&space.gc_spaces);
+        delete &space;
+    }
+}
+
+void free_static(value obj)
+{
+    auto header = static_cast<gc_header *>(magic::get_pointer(obj));
+
+    if (header->metaobject->destruct)
+        header->metaobject->destruct(obj);
+
+    free(large_object::of(header));
 }
 
-void globals::register_allocation(gc_header *obj)
+void globals::register_allocation(large_object *obj)
 {
+    std::lock_guard<std::mutex> lock(heap_mutex());
     list_insert(globals::allocations(), &obj->gc_objects);
 }
 
 void *object_data(value obj)
 {
+    if (magic::is_cell(obj))
+        return magic::get_cell(obj);
+
     if (!magic::is_pointer(obj))
         return nullptr;
 
@@ -163,6 +1760,9 @@ void *object_data(value obj)
 
 metatype_t *object_metaobject(value obj)
 {
+    if (magic::is_cell(obj))
+        return cell_page::of(magic::get_cell(obj))->metaobject;
+
     if (!magic::is_pointer(obj))
         return nullptr;
 
@@ -172,7 +1772,7 @@ metatype_t *object_metaobject(value obj)
 
 scope::scope()
 {
-    list_insert(globals::scopes(), &gc_scopes);
+    list_insert(scopes_of_thread(), &gc_scopes);
 }
 
 
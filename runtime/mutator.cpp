@@ -0,0 +1,207 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+namespace noldor {
+
+// Stopping the world is a handshake on `safe`: a mutator sets it before it
+// stops touching the heap and clears it before it starts again, the stopper
+// sets stop_requested and then waits for every other mutator to be safe.
+// Both sides store before they load, so at least one sees the other.
+
+struct mutator_t {
+    std::atomic<bool> safe { false };
+    list_t gc_mutators;
+
+    mutator_t();
+    ~mutator_t();
+};
+
+static std::mutex &world_mutex()
+{
+    return globals::isolate()->world_mutex;
+}
+
+static std::condition_variable &world_cv()
+{
+    return globals::isolate()->world_cv;
+}
+
+static list_t *mutators()
+{
+    return &globals::isolate()->mutators;
+}
+
+static thread_local mutator_t *current_mutator = nullptr;
+
+static void wait_for_world(std::unique_lock<std::mutex> &lock)
+{
+    world_cv().wait(lock, [] { return !globals::stop_requested().load(); });
+}
+
+mutator_t::mutator_t()
+{
+    std::unique_lock<std::mutex> lock(world_mutex());
+    wait_for_world(lock);
+
+    list_insert(mutators(), &this->gc_mutators);
+    globals::isolate()->n_mutators++;
+    current_mutator = this;
+}
+
+mutator_t::~mutator_t()
+{
+    safe.store(true);
+
+    std::lock_guard<std::mutex> lock(world_mutex());
+
+    list_remove(&this->gc_mutators);
+    globals::isolate()->n_mutators--;
+    current_mutator = nullptr;
+
+    world_cv().notify_all();
+}
+
+void attach_mutator()
+{
+    static thread_local mutator_t mutator;
+    (void) mutator;
+}
+
+void forget_other_mutators()
+{
+    list_t *list = mutators();
+    list->next = list->prev = list;
+
+    if (current_mutator)
+        list_insert(list, &current_mutator->gc_mutators);
+
+    globals::isolate()->n_mutators = current_mutator ? 1 : 0;
+}
+
+bool is_multithreaded()
+{
+    return globals::isolate()->n_mutators.load(std::memory_order_relaxed) > 1;
+}
+
+void safepoint_slow()
+{
+    if (globals::isolate()->collect_requested.load())
+        collect_if_requested();
+
+    mutator_t *self = current_mutator;
+    if (!self)
+        return;
+
+    std::unique_lock<std::mutex> lock(world_mutex());
+
+    if (!globals::stop_requested().load())
+        return;
+
+    flush_allocation_counts();
+    self->safe.store(true);
+    world_cv().notify_all();
+    wait_for_world(lock);
+    self->safe.store(false);
+}
+
+blocking_region::blocking_region()
+    : was_safe(!current_mutator || current_mutator->safe.load())
+{
+    if (was_safe)
+        return;
+
+    flush_allocation_counts();
+    current_mutator->safe.store(true);
+
+    if (globals::stop_requested().load()) {
+        std::lock_guard<std::mutex> lock(world_mutex());
+        world_cv().notify_all();
+    }
+}
+
+blocking_region::~blocking_region()
+{
+    if (was_safe)
+        return;
+
+    for (;;) {
+        current_mutator->safe.store(false);
+
+        if (!globals::stop_requested().load())
+            return;
+
+        current_mutator->safe.store(true);
+
+        std::unique_lock<std::mutex> lock(world_mutex());
+        world_cv().notify_all();
+        wait_for_world(lock);
+    }
+}
+
+world_stop::world_stop()
+{
+    mutator_t *self = current_mutator;
+
+    flush_allocation_counts();
+    std::unique_lock<std::mutex> lock(world_mutex());
+
+    // somebody else got there first, let them finish
+    while (globals::stop_requested().load()) {
+        if (self)
+            self->safe.store(true);
+
+        world_cv().notify_all();
+        wait_for_world(lock);
+
+        if (self)
+            self->safe.store(false);
+    }
+
+    globals::stop_requested().store(true);
+
+    // mutators may leave while we wait, so rescan from the top every time
+    auto all_safe = [self] {
+        for (mutator_t &m : INTRUSIVE_LIST_LOOP(mutators(), mutator_t, gc_mutators)) {
+            if (&m != self && !m.safe.load())
+                return false;
+        }
+
+        return true;
+    };
+
+    world_cv().wait(lock, all_safe);
+}
+
+world_stop::~world_stop()
+{
+    std::lock_guard<std::mutex> lock(world_mutex());
+    globals::stop_requested().store(false);
+    world_cv().notify_all();
+}
+
+}
@@ -0,0 +1,245 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <deque>
+
+namespace noldor {
+
+// Green threads are scheduled round robin from a run queue. Threads blocked
+// on ports or timers are registered with the event loop, which is run
+// whenever the queue is consulted; threads blocked on a join sit on the
+// joined thread's joiners list.
+
+struct scheduler_t : scope {
+    value current = list();
+    std::deque<value> runnable;
+    std::vector<value> event_waiting;   // blocked threads the event loop may wake
+    bool can_park = false;
+
+    void visit(gc_visit_fn_t visitor, void *data) override
+    {
+        visitor(&current, data);
+
+        for (value &t : runnable)
+            visitor(&t, data);
+
+        for (value &t : event_waiting)
+            visitor(&t, data);
+    }
+};
+
+static scheduler_t &scheduler()
+{
+    static thread_local scheduler_t sched;
+    return sched;
+}
+
+bool scheduler_can_park()
+{
+    return scheduler().can_park;
+}
+
+void scheduler_set_can_park(bool can_park)
+{
+    scheduler().can_park = can_park;
+}
+
+void scheduler_set_current(value t)
+{
+    scheduler().current = t;
+}
+
+value current_thread()
+{
+    return scheduler().current;
+}
+
+// runnable, or blocked on an event that may have happened
+bool scheduler_has_other_threads()
+{
+    return !scheduler().runnable.empty() || !scheduler().event_waiting.empty();
+}
+
+static void stop_waiting(value t)
+{
+    auto &sched = scheduler();
+    green_thread_data(t)->wait_ticket++;
+
+    sched.event_waiting.erase(std::remove_if(sched.event_waiting.begin(), sched.event_waiting.end(),
+                                             [t] (value w) { return eq(w, t); }),
+                              sched.event_waiting.end());
+}
+
+void scheduler_make_runnable(value t, uint64_t resume)
+{
+    auto data = green_thread_data(t);
+    data->status = green_thread_runnable;
+    data->resume = resume;
+    scheduler().runnable.push_back(t);
+}
+
+void scheduler_block(value t, uint64_t resume)
+{
+    auto data = green_thread_data(t);
+    data->status = green_thread_blocked;
+    data->resume = resume;
+}
+
+static void wait_event(value t)
+{
+    auto &waiting = scheduler().event_waiting;
+    if (std::find_if(waiting.begin(), waiting.end(), [t] (value w) { return eq(w, t); }) == waiting.end())
+        waiting.push_back(t);
+}
+
+// t must be blocked; a thread may wait on several fds and a timer at once
+void scheduler_wait_fd(value t, int fd, short events)
+{
+    wait_event(t);
+    event_loop_watch(fd, events, t, green_thread_data(t)->wait_ticket);
+}
+
+void scheduler_wait_timer(value t, double seconds)
+{
+    wait_event(t);
+    event_loop_timer(seconds, t, green_thread_data(t)->wait_ticket);
+}
+
+void scheduler_wake(value t, uint64_t ticket)
+{
+    auto data = green_thread_data(t);
+    if (data->status != green_thread_blocked || data->wait_ticket != ticket)
+        return;
+
+    stop_waiting(t);
+    scheduler_make_runnable(t, data->resume);
+}
+
+void scheduler_wait_join(value t, value target, uint64_t resume)
+{
+    auto data = green_thread_data(t);
+    data->status = green_thread_blocked;
+    data->resume = resume;
+    data->joining = target;
+
+    auto target_data = green_thread_data(target);
+    target_data->joiners = cons(t, target_data->joiners);
+}
+
+void scheduler_terminate(value t, value result, bool failed)
+{
+    auto data = green_thread_data(t);
+    data->status = green_thread_terminated;
+    data->result = result;
+    data->failed = failed;
+
+    for (value j = data->joiners; !is_null(j); j = cdr(j)) {
+        green_thread_data(car(j))->joining = list();
+        scheduler_make_runnable(car(j), green_thread_data(car(j))->resume);
+    }
+
+    data->joiners = list();
+}
+
+void scheduler_forget(value t)
+{
+    auto &sched = scheduler();
+
+    sched.runnable.erase(std::remove_if(sched.runnable.begin(), sched.runnable.end(),
+                                        [t] (value r) { return eq(r, t); }),
+                         sched.runnable.end());
+
+    stop_waiting(t);
+
+    auto data = green_thread_data(t);
+    if (is_thread(data->joining)) {
+        auto target = green_thread_data(data->joining);
+        value kept = list();
+
+        for (value j = target->joiners; !is_null(j); j = cdr(j)) {
+            if (!eq(car(j), t))
+                kept = cons(car(j), kept);
+        }
+
+        target->joiners = kept;
+        data->joining = list();
+    }
+}
+
+value scheduler_next()
+{
+    auto &sched = scheduler();
+
+    if (!sched.event_waiting.empty())
+        event_loop_run(sched.runnable.empty());
+
+    while (sched.runnable.empty() && !sched.event_waiting.empty())
+        event_loop_run(true);
+
+    if (sched.runnable.empty())
+        throw runtime_error("scheduler: deadlock, every thread is blocked");
+
+    value t = sched.runnable.front();
+    sched.runnable.pop_front();
+    sched.current = t;
+
+    return t;
+}
+
+void scheduler_wait_readable(int fd)
+{
+    if (!scheduler_can_park())
+        return;
+
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    int result;
+    EINTR_SAFE(result, ::poll, &pfd, 1, 0);
+
+    if (result == 0)
+        throw green_thread_park { fd, POLLIN };
+}
+
+void scheduler_wait_writable(int fd)
+{
+    if (!scheduler_can_park())
+        return;
+
+    struct pollfd pfd = { fd, POLLOUT, 0 };
+
+    int result;
+    EINTR_SAFE(result, ::poll, &pfd, 1, 0);
+
+    if (result == 0)
+        throw green_thread_park { fd, POLLOUT };
+}
+
+}
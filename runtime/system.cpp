@@ -68,20 +68,22 @@ bool delete_file(std::string filename)
     return remove(filename.c_str()) == 0;
 }
 
-static value command_line_args = list();
-static basic_scope command_line_args_scope { &command_line_args };
+// kept outside the heap so that every isolate can build its own list
+static std::vector<std::string> command_line_args;
 
 void set_command_line(int argc, char **argv)
 {
-    command_line_args = list();
-
-    for (int i = 0; i < argc; ++i)
-        command_line_args = cons(mk_string(argv[i]), command_line_args);
+    command_line_args.assign(argv, argv + argc);
 }
 
 value command_line()
 {
-    return command_line_args;
+    value result = list();
+
+    for (const std::string &arg : command_line_args)
+        result = cons(mk_string(arg), result);
+
+    return result;
 }
 
 static int value_to_exit_code(value obj)
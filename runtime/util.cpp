@@ -25,6 +25,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "noldor_impl.h"
 
+#include <cstdlib>
 #include <sstream>
 #include <mutex>
 
@@ -40,7 +41,7 @@ const char* noldor_exception::what() const noexcept
 }
 
 base_error::base_error(std::string msg, noldor::value irritants)
-    : noldor_exception(msg + ", irritants: " + printable(irritants)), _irritants(irritants)
+    : noldor_exception(std::move(msg)), _irritants(irritants)
 {}
 
 value base_error::irritants() const noexcept
@@ -48,6 +49,24 @@ value base_error::irritants() const noexcept
     return _irritants;
 }
 
+const char *base_error::message() const noexcept
+{
+    return noldor_exception::what();
+}
+
+const char *base_error::what() const noexcept
+{
+    if (_what.empty()) {
+        try {
+            _what = std::string(message()) + ", irritants: " + printable(_irritants);
+        } catch (...) {
+            return message();
+        }
+    }
+
+    return _what.c_str();
+}
+
 void list_insert(list_t *list, list_t *elem)
 {
     elem->prev = list;
@@ -207,32 +226,52 @@ inline auto apply_tuple(FunType fn, std::tuple<Args...> &&arg_tuple)
 X_NOLDOR_SHARED_PROCEDURES(MAKE_C_FUNC_DISPATCHER)
 #undef MAKE_C_FUNC_DISPATCHER
 
-void noldor_init(int argc, char **argv)
+void init_isolate()
 {
-    static std::mutex mutex;
-    static bool initialized = false;
+    isolate_t *isolate = globals::isolate();
 
-    if (!initialized) {
-        std::lock_guard<std::mutex> locker(mutex);
+    std::call_once(isolate->initialized, [isolate] {
+        isolate->global_environment = mk_empty_environment();
+        isolate->interaction_environment = mk_environment();
 
-        if (!initialized) {
 #define REGISTER_DISPATCHER(LISP_NAME, C_NAME, C_RETURN, ...) \
-    environment_define(environment_global(), \
-                       symbol(LISP_NAME), \
-                       mk_primitive_procedure(#C_NAME, C_NAME##_dispatcher));
-            X_NOLDOR_SHARED_PROCEDURES(REGISTER_DISPATCHER)
+        environment_define(environment_global(), \
+                           symbol(LISP_NAME), \
+                           mk_primitive_procedure(#C_NAME, C_NAME##_dispatcher));
+        X_NOLDOR_SHARED_PROCEDURES(REGISTER_DISPATCHER)
 #undef REGISTER_DISPATCHER
 
-            set_command_line(argc, argv);
+        register_control_procedures();
+    });
+}
 
-            initialized = true;
-        }
-    }
+static isolate_t *initial_isolate = nullptr;
+
+// joins the workers of the isolate noldor_init set up the way an isolate's
+// own thread does when it finishes, unless exit came from another isolate
+static void shutdown_initial_isolate()
+{
+    if (globals::isolate() == initial_isolate)
+        work_pool_shutdown();
+}
+
+void noldor_init(int argc, char **argv)
+{
+    attach_mutator();
+    init_isolate();
+
+    static std::once_flag command_line_set;
+    std::call_once(command_line_set, [argc, argv] {
+        set_command_line(argc, argv);
+
+        initial_isolate = globals::isolate();
+        std::atexit(shutdown_initial_isolate);
+    });
 }
 
 bool is_tagged_list(value list, value tag)
 {
-    return is_pair(list) && eq(car(list), tag);
+    return magic::has_type_tag(list, type_tag_pair) && eq(car(list), tag);
 }
 
 value assq(value obj, value list)
@@ -0,0 +1,228 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <algorithm>
+#include <deque>
+#include <thread>
+
+namespace noldor {
+
+// Every isolate gets a fixed pool of worker threads, one per CPU, the first
+// time it has work for them. Each worker owns a deque: it pushes and pops
+// new work at the back while idle workers steal the oldest work from the
+// front. Threads outside the pool submit to a shared queue instead.
+
+struct work_deque {
+    std::mutex mutex;
+    std::deque<value> items;
+};
+
+struct work_pool : scope {
+    std::vector<std::unique_ptr<work_deque>> deques;    // last one is shared
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> n_queued { 0 };
+    std::atomic<size_t> n_idle { 0 };
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+    bool stopping = false;
+
+    void visit(gc_visit_fn_t visitor, void *data) override
+    {
+        for (auto &deque : deques) {
+            std::lock_guard<std::mutex> lock(deque->mutex);
+
+            for (value &item : deque->items)
+                visitor(&item, data);
+        }
+    }
+};
+
+static thread_local work_deque *own_deque = nullptr;
+
+static uint32_t steal_start(uint32_t n)
+{
+    static thread_local uint32_t seed = uint32_t(reinterpret_cast<uintptr_t>(&seed) >> 4) | 1;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return seed % n;
+}
+
+static bool take(work_pool &pool, value &item)
+{
+    if (pool.n_queued.load() == 0)
+        return false;
+
+    if (own_deque) {
+        std::lock_guard<std::mutex> lock(own_deque->mutex);
+
+        if (!own_deque->items.empty()) {
+            item = own_deque->items.back();
+            own_deque->items.pop_back();
+            pool.n_queued--;
+            return true;
+        }
+    }
+
+    uint32_t n = uint32_t(pool.deques.size());
+    uint32_t start = steal_start(n);
+
+    for (uint32_t i = 0; i < n; ++i) {
+        work_deque &victim = *pool.deques[(start + i) % n];
+
+        if (&victim == own_deque)
+            continue;
+
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.items.empty()) {
+            item = victim.items.front();
+            victim.items.pop_front();
+            pool.n_queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void worker_main(isolate_t *isolate, work_pool *pool, size_t index)
+{
+    globals::set_isolate(isolate);
+    attach_mutator();
+    own_deque = pool->deques[index].get();
+
+    for (;;) {
+        safepoint();
+
+        value item = list();
+
+        if (take(*pool, item)) {
+            basic_scope roots { &item };
+            future_run(item);
+            continue;
+        }
+
+        blocking_region blocking;
+        std::unique_lock<std::mutex> lock(pool->idle_mutex);
+
+        pool->n_idle++;
+        pool->idle_cv.wait(lock, [pool] { return pool->stopping || pool->n_queued.load() > 0; });
+        pool->n_idle--;
+
+        if (pool->stopping)
+            return;
+    }
+}
+
+static work_pool *isolate_pool()
+{
+    isolate_t *isolate = globals::isolate();
+    std::lock_guard<std::mutex> lock(isolate->world_mutex);
+
+    if (isolate->work_pool)
+        return isolate->work_pool;
+
+    size_t n_workers = std::max(1u, std::thread::hardware_concurrency());
+    auto pool = new work_pool;
+
+    for (size_t i = 0; i <= n_workers; ++i)
+        pool->deques.emplace_back(new work_deque);
+
+    for (size_t i = 0; i < n_workers; ++i)
+        pool->workers.emplace_back(worker_main, isolate, pool, i);
+
+    return isolate->work_pool = pool;
+}
+
+void work_pool_submit(value item)
+{
+    work_pool *pool = isolate_pool();
+    work_deque *deque = own_deque ? own_deque : pool->deques.back().get();
+
+    {
+        std::lock_guard<std::mutex> lock(deque->mutex);
+        deque->items.push_back(item);
+    }
+
+    pool->n_queued++;
+
+    if (pool->n_idle.load() > 0) {
+        { std::lock_guard<std::mutex> lock(pool->idle_mutex); }
+        pool->idle_cv.notify_one();
+    }
+}
+
+size_t work_pool_size()
+{
+    return isolate_pool()->workers.size();
+}
+
+bool work_pool_help()
+{
+    work_pool *pool = globals::isolate()->work_pool;
+    value item = list();
+
+    if (!pool || !take(*pool, item))
+        return false;
+
+    basic_scope roots { &item };
+    future_run(item);
+    return true;
+}
+
+void work_pool_shutdown()
+{
+    isolate_t *isolate = globals::isolate();
+    work_pool *pool = isolate->work_pool;
+
+    if (!pool)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->idle_mutex);
+        pool->stopping = true;
+    }
+
+    pool->idle_cv.notify_all();
+
+    {
+        blocking_region blocking;
+
+        for (std::thread &worker : pool->workers)
+            worker.join();
+    }
+
+    isolate->work_pool = nullptr;
+    delete pool;
+}
+
+}
@@ -54,7 +54,8 @@ static metatype_t *true_metaobject()
         typeflags(typeflags_self_eval | typeflags_static),
         bool_destruct,
         bool_gc_visit,
-        true_repr
+        true_repr,
+        type_tag_none
     };
 
     return &metaobject;
@@ -67,7 +68,8 @@ static metatype_t *false_metaobject()
         typeflags(typeflags_self_eval | typeflags_static),
         bool_destruct,
         bool_gc_visit,
-        false_repr
+        false_repr,
+        type_tag_none
     };
 
     return &metaobject;
@@ -0,0 +1,313 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <deque>
+#include <unordered_set>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+
+namespace noldor {
+
+// Channels carry copies of data between isolates, or between any threads.
+// Every queued message has one byte waiting in the pipe, so receivers can
+// wait on the read end and green threads can park on it. The read end does
+// not block: receivers woken for the same byte all try to take it.
+
+struct channel_state {
+    std::mutex mutex;
+    std::deque<message_t> queue;
+    int fds[2] = { -1, -1 };
+
+    ~channel_state()
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+};
+
+struct channel_t {
+    std::shared_ptr<channel_state> state;
+};
+
+static void channel_destruct(value self)
+{
+    object_data_as<channel_t *>(self)->~channel_t();
+}
+
+static std::string channel_repr(value)
+{
+    return "<#channel>";
+}
+
+static metatype_t *channel_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        channel_destruct,
+        nullptr,
+        channel_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+bool is_channel(value val)
+{
+    return object_metaobject(val) == channel_metaobject();
+}
+
+static value mk_channel(std::shared_ptr<channel_state> state)
+{
+    return object_allocate<channel_t>(channel_metaobject(), channel_t { std::move(state) });
+}
+
+value make_channel()
+{
+    auto state = std::make_shared<channel_state>();
+
+    if (::pipe(state->fds) == -1)
+        throw runtime_error(std::string("make-channel: ") + strerror(errno));
+
+    fcntl(state->fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(state->fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(state->fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(state->fds[1], F_SETFL, O_NONBLOCK);
+
+    return mk_channel(std::move(state));
+}
+
+static bool is_shared_as_is(value datum)
+{
+    if (!magic::is_pointer(datum) && !magic::is_cell(datum))
+        return true;
+
+    return object_metaobject(datum)->flags & typeflags_static;
+}
+
+// path holds the pairs and vectors being copied, for telling a cycle from
+// data that is merely shared; shared data is copied once for every reference
+static void message_append(message_t &message, value datum, std::unordered_set<uint64_t> &path)
+{
+    message_node node;
+
+    // a weak symbol may be gone by the time the message is read
+    if (is_symbol(datum) && is_weak_symbol(datum)) {
+        node.kind = message_symbol;
+        node.text = symbol_to_string(datum);
+    } else if (is_shared_as_is(datum)) {
+        node.datum = datum;
+    } else if (is_char(datum)) {
+        node.kind = message_char;
+        node.length = char_get(datum);
+    } else if (is_string(datum)) {
+        node.kind = message_string;
+        node.text = string_get(datum);
+    } else if (is_channel(datum)) {
+        node.kind = message_channel;
+        node.channel = object_data_as<channel_t *>(datum)->state;
+    } else if (is_vector(datum)) {
+        if (!path.insert(datum).second)
+            throw type_error("cannot copy circular data between isolates", datum);
+
+        std::vector<value> elements = vector_get(datum);
+
+        node.kind = message_vector;
+        node.length = uint32_t(elements.size());
+        message.push_back(std::move(node));
+
+        for (value element : elements)
+            message_append(message, element, path);
+
+        path.erase(datum);
+        return;
+    } else if (is_pair(datum)) {
+        size_t at = message.size();
+        uint32_t length = 0;
+        value spine = datum;
+
+        node.kind = message_list;
+        message.push_back(std::move(node));
+
+        for (; is_pair(datum); datum = cdr(datum), ++length) {
+            if (!path.insert(datum).second)
+                throw type_error("cannot copy circular data between isolates", datum);
+
+            message_append(message, car(datum), path);
+        }
+
+        message[at].length = length;
+        message_append(message, datum, path);
+
+        for (; is_pair(spine); spine = cdr(spine))
+            path.erase(spine);
+
+        return;
+    } else {
+        throw type_error("cannot copy between isolates", datum);
+    }
+
+    message.push_back(std::move(node));
+}
+
+message_t message_from(value datum)
+{
+    message_t message;
+    std::unordered_set<uint64_t> path;
+    message_append(message, datum, path);
+    return message;
+}
+
+static value message_value(const message_t &message, size_t &at)
+{
+    const message_node &node = message[at++];
+
+    switch (node.kind) {
+    case message_immediate:
+        return node.datum;
+    case message_char:
+        return mk_char(node.length);
+    case message_string:
+        return mk_string(node.text);
+    case message_symbol:
+        return string_to_symbol(node.text);
+    case message_channel:
+        return mk_channel(node.channel);
+    case message_vector: {
+        std::vector<value> elements;
+        elements.reserve(node.length);
+
+        for (uint32_t i = 0; i < node.length; ++i)
+            elements.push_back(message_value(message, at));
+
+        return mk_vector(std::move(elements));
+    }
+    case message_list: {
+        std::vector<value> elements;
+        elements.reserve(node.length);
+
+        for (uint32_t i = 0; i < node.length; ++i)
+            elements.push_back(message_value(message, at));
+
+        value result = message_value(message, at);
+
+        for (auto it = elements.rbegin(); it != elements.rend(); ++it)
+            result = cons(*it, result);
+
+        return result;
+    }
+    }
+
+    NOLDOR_UNREACHABLE();
+}
+
+value message_value(const message_t &message)
+{
+    size_t at = 0;
+    return message_value(message, at);
+}
+
+value channel_send(value ch, value datum)
+{
+    check_type(is_channel, ch, "channel-send!: expected channel");
+
+    auto state = object_data_as<channel_t *>(ch)->state;
+    message_t message = message_from(datum);
+
+    // the byte and the message go in together, so a receiver that gets the
+    // byte finds the message; a full pipe parks the sender before either
+    // goes in, or holds it back if it cannot park
+    for (;;) {
+        char byte = 0;
+        ssize_t result;
+        int error;
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            EINTR_SAFE(result, ::write, state->fds[1], &byte, 1);
+
+            if (result == 1) {
+                state->queue.push_back(std::move(message));
+                return ch;
+            }
+
+            error = errno;
+        }
+
+        if (error != EAGAIN && error != EWOULDBLOCK)
+            throw runtime_error(std::string("channel-send!: ") + strerror(error));
+
+        scheduler_wait_writable(state->fds[1]);
+
+        blocking_region blocking;
+        struct pollfd pfd = { state->fds[1], POLLOUT, 0 };
+        EINTR_SAFE(result, ::poll, &pfd, 1, -1);
+    }
+}
+
+value channel_receive(value ch)
+{
+    check_type(is_channel, ch, "channel-receive: expected channel");
+
+    auto state = object_data_as<channel_t *>(ch)->state;
+
+    // a receiver that lost the byte to another one parks or waits again
+    for (;;) {
+        scheduler_wait_readable(state->fds[0]);
+
+        char byte;
+        ssize_t result;
+        EINTR_SAFE(result, ::read, state->fds[0], &byte, 1);
+
+        if (result == 1)
+            break;
+
+        if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            throw runtime_error(std::string("channel-receive: ") + (result == 0 ? "pipe closed" : strerror(errno)));
+
+        if (!scheduler_can_park()) {
+            blocking_region blocking;
+            struct pollfd pfd = { state->fds[0], POLLIN, 0 };
+            EINTR_SAFE(result, ::poll, &pfd, 1, -1);
+        }
+    }
+
+    message_t message;
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        message = std::move(state->queue.front());
+        state->queue.pop_front();
+    }
+
+    return message_value(message);
+}
+
+}
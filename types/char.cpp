@@ -23,7 +23,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 */
 
-#include "noldor.h"
+#include "noldor_impl.h"
 #include <sstream>
 
 namespace noldor {
@@ -91,6 +91,7 @@ static metatype_t *char_metaobject()
         char_destruct,
         char_gc_visit,
         char_repr,
+        type_tag_char
     };
 
     return &metaobject;
@@ -109,7 +110,7 @@ uint32_t char_get(value val)
 
 bool is_char(value v)
 {
-    return object_metaobject(v) == char_metaobject();
+    return magic::has_type_tag(v, type_tag_char);
 }
 
 }
@@ -23,7 +23,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 */
 
-#include "noldor.h"
+#include "noldor_impl.h"
 #include <sstream>
 #include <unordered_set>
 
@@ -54,7 +54,8 @@ metatype_t *null_metaobject()
         typeflags_static,
         null_destruct,
         null_gc_visit,
-        null_repr
+        null_repr,
+        type_tag_none
     };
 
     return &metaobject;
@@ -78,11 +79,15 @@ bool is_null(value val)
 
 // pair type
 
+// pairs are allocated headerless from dedicated cell pages, see allocate_cell
+
 struct pair_t {
     value car;
     value cdr;
 };
 
+static_assert(sizeof(pair_t) == 16, "pair cells are expected to be 16 bytes");
+
 static void pair_destruct(value val)
 {
     object_data_as<pair_t *>(val)->~pair_t();
@@ -120,10 +125,11 @@ static std::string pair_repr(value val)
 static metatype_t *pair_metaobject() {
     static metatype_t metaobject = {
         METATYPE_VERSION,
-        typeflags_none,
+        typeflags_movable,
         pair_destruct,
         pair_gc_visit,
-        pair_repr
+        pair_repr,
+        type_tag_pair
     };
 
     return &metaobject;
@@ -131,12 +137,12 @@ static metatype_t *pair_metaobject() {
 
 value cons(value a, value b)
 {
-    return object_allocate<pair_t>(pair_metaobject(), {a, b});
+    return cell_allocate<pair_t>(pair_metaobject(), {a, b});
 }
 
 bool is_pair(value v)
 {
-    return object_metaobject(v) == pair_metaobject();
+    return magic::has_type_tag(v, type_tag_pair);
 }
 
 value car(value v)
@@ -154,13 +160,17 @@ value cdr(value v)
 value set_car(value pair, value val)
 {
     check_type(is_pair, pair, "set_car: expected pair");
-    return object_data_as<pair_t *>(pair)->car = val;
+    gc_store(&object_data_as<pair_t *>(pair)->car, val);
+    gc_write_barrier(pair);
+    return val;
 }
 
 value set_cdr(value pair, value val)
 {
     check_type(is_pair, pair, "set_cdr: expected pair");
-    return object_data_as<pair_t *>(pair)->cdr = val;
+    gc_store(&object_data_as<pair_t *>(pair)->cdr, val);
+    gc_write_barrier(pair);
+    return val;
 }
 
 // list utilities
@@ -0,0 +1,305 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace noldor {
+
+// Continuations are captured by freezing the live thread stack into an
+// immutable segment, so capture never copies frames. Segments chain to the
+// frames frozen before them; a thread or continuation refers to the bottom
+// part of a segment by its size, and frames are copied back a chunk at a
+// time as the thread returns into them.
+
+static const size_t UNDERFLOW_CHUNK = 64;
+
+struct stack_segment_t {
+    std::vector<uint64_t> slots;
+    value below = list();
+    size_t below_size = 0;
+    size_t base = 0;        // stack index of slots[0]
+};
+
+static void stack_segment_destruct(value self)
+{
+    object_data_as<stack_segment_t *>(self)->~stack_segment_t();
+}
+
+static void stack_segment_gc_visit(value self, gc_visit_fn_t visitor, void *data)
+{
+    auto segment = object_data_as<stack_segment_t *>(self);
+    visitor(&segment->below, data);
+
+    for (uint64_t &slot : segment->slots)
+        visitor(reinterpret_cast<value *>(&slot), data);
+}
+
+static std::string stack_segment_repr(value)
+{
+    return "<#stack-segment>";
+}
+
+static metatype_t *stack_segment_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        stack_segment_destruct,
+        stack_segment_gc_visit,
+        stack_segment_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+static stack_segment_t *segment_data(uint64_t segment)
+{
+    return object_data_as<stack_segment_t *>(segment);
+}
+
+uint64_t new_thread_id()
+{
+    static std::atomic<uint64_t> next_id { 1 };
+    return next_id++;
+}
+
+size_t thread_t::depth() const
+{
+    if (segment_size == 0)
+        return stack.size();
+
+    return segment_data(segment)->base + segment_size + stack.size();
+}
+
+uint64_t thread_t::slot(size_t index) const
+{
+    size_t base = depth() - stack.size();
+    if (index >= base)
+        return stack.at(index - base);
+
+    value seg = segment;
+    while (index < segment_data(seg)->base)
+        seg = segment_data(seg)->below;
+
+    return segment_data(seg)->slots.at(index - segment_data(seg)->base);
+}
+
+void thread_t::truncate(size_t new_depth)
+{
+    size_t base = depth() - stack.size();
+    if (new_depth >= base) {
+        stack.resize(new_depth - base);
+        return;
+    }
+
+    stack.clear();
+
+    while (new_depth <= segment_data(segment)->base) {
+        auto data = segment_data(segment);
+        segment = data->below;
+        segment_size = data->below_size;
+
+        if (segment_size == 0)
+            return;
+    }
+
+    segment_size = new_depth - segment_data(segment)->base;
+}
+
+void thread_t::freeze()
+{
+    if (stack.empty())
+        return;
+
+    value seg = object_allocate<stack_segment_t>(stack_segment_metaobject(), {});
+    auto data = segment_data(seg);
+
+    data->base = depth() - stack.size();
+    data->below = segment_size ? value(segment) : list();
+    data->below_size = segment_size;
+    data->slots.swap(stack);
+
+    segment = seg;
+    segment_size = data->slots.size();
+}
+
+void thread_t::underflow()
+{
+    if (segment_size == 0)
+        throw noldor::base_error("stack underflow", list());
+
+    auto data = segment_data(segment);
+    size_t n = std::min(segment_size, UNDERFLOW_CHUNK);
+    size_t from = segment_size - n;
+
+    stack.assign(data->slots.begin() + ptrdiff_t(from),
+                 data->slots.begin() + ptrdiff_t(segment_size));
+    segment_size = from;
+
+    if (segment_size == 0) {
+        segment = data->below;
+        segment_size = data->below_size;
+    }
+}
+
+struct continuation_t {
+    value segment;
+    size_t segment_size;
+    value handlers;
+    value winders;
+    value prompts;
+    uint64_t owner;
+};
+
+static void continuation_destruct(value self)
+{
+    object_data_as<continuation_t *>(self)->~continuation_t();
+}
+
+static void continuation_gc_visit(value self, gc_visit_fn_t visitor, void *data)
+{
+    auto k = object_data_as<continuation_t *>(self);
+    visitor(&k->segment, data);
+    visitor(&k->handlers, data);
+    visitor(&k->winders, data);
+    visitor(&k->prompts, data);
+}
+
+static std::string continuation_repr(value)
+{
+    return "<#continuation>";
+}
+
+static metatype_t *continuation_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        continuation_destruct,
+        continuation_gc_visit,
+        continuation_repr,
+        type_tag_continuation
+    };
+
+    return &metaobject;
+}
+
+value mk_continuation(thread_t &thread, value handlers, value winders, value prompts)
+{
+    thread.freeze();
+
+    value segment = thread.segment_size ? value(thread.segment) : list();
+    return object_allocate<continuation_t>(continuation_metaobject(), {
+        segment, thread.segment_size, handlers, winders, prompts, thread.id
+    });
+}
+
+bool is_continuation(value val)
+{
+    return magic::has_type_tag(val, type_tag_continuation);
+}
+
+uint64_t continuation_owner(value k)
+{
+    check_type(is_continuation, k, "continuation_owner: expected continuation");
+    return object_data_as<continuation_t *>(k)->owner;
+}
+
+value continuation_winders(value k)
+{
+    check_type(is_continuation, k, "continuation_winders: expected continuation");
+    return object_data_as<continuation_t *>(k)->winders;
+}
+
+void continuation_reinstate(thread_t &thread, value k)
+{
+    check_type(is_continuation, k, "continuation_reinstate: expected continuation");
+    auto data = object_data_as<continuation_t *>(k);
+
+    thread.stack.clear();
+    thread.segment = data->segment;
+    thread.segment_size = data->segment_size;
+    thread.assign(reg::handlers, data->handlers);
+    thread.assign(reg::winders, data->winders);
+    thread.assign(reg::prompts, data->prompts);
+}
+
+static void composable_continuation_destruct(value self)
+{
+    object_data_as<composable_continuation_t *>(self)->~composable_continuation_t();
+}
+
+static void composable_continuation_gc_visit(value self, gc_visit_fn_t visitor, void *data)
+{
+    auto k = object_data_as<composable_continuation_t *>(self);
+    visitor(&k->handlers, data);
+    visitor(&k->winders, data);
+    visitor(&k->outer_winders, data);
+
+    for (uint64_t &slot : k->slots)
+        visitor(reinterpret_cast<value *>(&slot), data);
+}
+
+static std::string composable_continuation_repr(value)
+{
+    return "<#composable-continuation>";
+}
+
+static metatype_t *composable_continuation_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        composable_continuation_destruct,
+        composable_continuation_gc_visit,
+        composable_continuation_repr,
+        type_tag_composable_continuation
+    };
+
+    return &metaobject;
+}
+
+value mk_composable_continuation(composable_continuation_t data)
+{
+    return object_allocate<composable_continuation_t>(composable_continuation_metaobject(), std::move(data));
+}
+
+bool is_composable_continuation(value val)
+{
+    return magic::has_type_tag(val, type_tag_composable_continuation);
+}
+
+composable_continuation_t *composable_continuation_data(value k)
+{
+    check_type(is_composable_continuation, k, "composable_continuation_data: expected composable continuation");
+    return object_data_as<composable_continuation_t *>(k);
+}
+
+}
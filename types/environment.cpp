@@ -23,7 +23,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 */
 
-#include "noldor.h"
+#include "noldor_impl.h"
 #include <unordered_map>
 #include <numeric>
 #include <sstream>
@@ -32,10 +32,14 @@ namespace noldor {
 
 struct environment_t {
     environment_t() = default;
-    environment_t(value o) : outer(o) {}
+    environment_t(value o) : outer(o), toplevel(is_null(o) || eq(o, environment_global())) {}
 
     value outer = list();
     std::unordered_map<uint64_t, value> symtab, parameters;
+
+    // toplevel environments are shared by every OS thread, procedure frames
+    // are only extended by the thread that is running the procedure
+    bool toplevel = true;
 };
 
 static void environment_destruct(value self)
@@ -46,6 +50,7 @@ static void environment_destruct(value self)
 static void environment_gc_visit(value self, gc_visit_fn_t visitor, void *data)
 {
     auto env = object_data_as<environment_t *>(self);
+    marking_guard guard;
 
     for (auto &pair : env->symtab)
         visitor(&pair.second, data);
@@ -80,7 +85,8 @@ static metatype_t *environment_metaobject()
         typeflags_none,
         environment_destruct,
         environment_gc_visit,
-        environment_repr
+        environment_repr,
+        type_tag_environment
     };
 
     return &metaobject;
@@ -88,8 +94,7 @@ static metatype_t *environment_metaobject()
 
 value environment_global()
 {
-    static value global = mk_empty_environment();
-    return global;
+    return globals::isolate()->global_environment;
 }
 
 value mk_environment(value outer)
@@ -110,7 +115,7 @@ value mk_empty_environment()
 
 bool is_environment(value v)
 {
-    return object_metaobject(v) == environment_metaobject();
+    return magic::has_type_tag(v, type_tag_environment);
 }
 
 value environment_find(value env, value sym)
@@ -155,7 +160,8 @@ value environment_set(value env, value sym, value val)
         throw variable_error("undefined variable", sym);
 
     auto data = static_cast<environment_t *>(object_data(env));
-    data->symtab.at(sym) = val;
+    gc_store(&data->symtab.at(sym), val);
+    gc_write_barrier(env);
     return val;
 }
 
@@ -165,9 +171,30 @@ value environment_define(value env, value sym, value val)
     check_type(is_symbol, sym, "environment_define: expected symbol as second argument");
 
     auto data = static_cast<environment_t *>(object_data(env));
-    auto res = data->symtab.emplace(sym, val);
-    if (!res.second)
-        data->symtab.at(sym) = val;
+
+    auto it = data->symtab.find(sym);
+    if (it != data->symtab.end()) {
+        gc_store(&it->second, val);
+        gc_write_barrier(env);
+        return val;
+    }
+
+    // the table holds names only by address, which a weak symbol must keep
+    if (is_weak_symbol(sym))
+        sym = symbol(symbol_to_string(sym));
+
+    // a new binding may rehash the table under a concurrent lookup
+    if (data->toplevel && is_multithreaded()) {
+        basic_scope roots { &val };
+        world_stop stop;
+        marking_guard guard;
+        data->symtab.emplace(sym, val);
+    } else {
+        marking_guard guard;
+        data->symtab.emplace(sym, val);
+    }
+
+    gc_write_barrier(env);
     return val;
 }
 
@@ -191,13 +218,7 @@ value null_environment(value version)
 
 value interaction_environment()
 {
-    static value env = mk_environment();
-    static basic_scope scope;
-
-    if (scope.variables.empty())
-        scope.variables = { &env };
-
-    return env;
+    return globals::isolate()->interaction_environment;
 }
 
 value parametrize(value parameters, dot_tag, value body)
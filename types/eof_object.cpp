@@ -49,7 +49,8 @@ static metatype_t *eof_metaobject()
         typeflags_none,
         eof_object_destruct,
         eof_object_gc_visit,
-        eof_object_repr
+        eof_object_repr,
+        type_tag_none
     };
 
     return &metaobject;
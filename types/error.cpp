@@ -0,0 +1,129 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "noldor_impl.h"
+#include <sstream>
+
+namespace noldor {
+
+struct error_object_t {
+    value message;
+    value irritants;
+    error_kind kind;
+};
+
+static void error_object_destruct(value self)
+{
+    object_data_as<error_object_t *>(self)->~error_object_t();
+}
+
+static void error_object_gc_visit(value self, gc_visit_fn_t visitor, void *data)
+{
+    auto err = object_data_as<error_object_t *>(self);
+    visitor(&err->message, data);
+    visitor(&err->irritants, data);
+}
+
+static std::string error_object_repr(value self)
+{
+    auto err = object_data_as<error_object_t *>(self);
+
+    std::stringstream stream;
+    stream << "<#error-object " << err->message;
+
+    for (value irritant = err->irritants; is_pair(irritant); irritant = cdr(irritant))
+        stream << " " << car(irritant);
+
+    stream << ">";
+    return stream.str();
+}
+
+static metatype_t *error_object_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        error_object_destruct,
+        error_object_gc_visit,
+        error_object_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+value mk_error_object(value message, value irritants, error_kind kind)
+{
+    return object_allocate<error_object_t>(error_object_metaobject(), { message, irritants, kind });
+}
+
+value error_object_from_exception(const noldor_exception &e)
+{
+    if (auto raised = dynamic_cast<const raise_error *>(&e))
+        return raised->irritants();
+
+    if (auto err = dynamic_cast<const base_error *>(&e)) {
+        auto kind = dynamic_cast<const file_error *>(&e) ? error_kind_file : error_kind_general;
+
+        // primitives throw either a single irritant or a list of them
+        value irritants = err->irritants();
+        if (!is_list(irritants))
+            irritants = list(irritants);
+
+        return mk_error_object(mk_string(err->message()), irritants, kind);
+    }
+
+    auto kind = dynamic_cast<const parse_error *>(&e) ? error_kind_read : error_kind_general;
+    return mk_error_object(mk_string(e.what()), list(), kind);
+}
+
+bool is_error_object(value val)
+{
+    return object_metaobject(val) == error_object_metaobject();
+}
+
+value error_object_message(value val)
+{
+    check_type(is_error_object, val, "error_object_message: expected error object");
+    return object_data_as<error_object_t *>(val)->message;
+}
+
+value error_object_irritants(value val)
+{
+    check_type(is_error_object, val, "error_object_irritants: expected error object");
+    return object_data_as<error_object_t *>(val)->irritants;
+}
+
+bool is_file_error(value val)
+{
+    return is_error_object(val) && object_data_as<error_object_t *>(val)->kind == error_kind_file;
+}
+
+bool is_read_error(value val)
+{
+    return is_error_object(val) && object_data_as<error_object_t *>(val)->kind == error_kind_read;
+}
+
+}
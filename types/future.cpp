@@ -0,0 +1,195 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+namespace noldor {
+
+// A future applies a procedure to its arguments on the isolate's work pool.
+// Touching a future nobody has started runs it right away on the touching
+// thread, so a program whose futures never reach a worker simply runs them
+// in order.
+
+enum future_status {
+    future_pending,
+    future_running,
+    future_done
+};
+
+struct future_state {
+    std::atomic<int> status { future_pending };
+    bool failed = false;
+};
+
+struct future_t {
+    value proc = list();
+    value args = list();
+    value result = list();  // value, or raised object if failed
+    std::shared_ptr<future_state> state = std::make_shared<future_state>();
+};
+
+// completions are rare next to everything else, one cv serves all futures
+static std::mutex &finished_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::condition_variable &finished_cv()
+{
+    static std::condition_variable cv;
+    return cv;
+}
+
+static void future_destruct(value self)
+{
+    object_data_as<future_t *>(self)->~future_t();
+}
+
+static void future_gc_visit(value self, gc_visit_fn_t visitor, void *data)
+{
+    auto f = object_data_as<future_t *>(self);
+    visitor(&f->proc, data);
+    visitor(&f->args, data);
+    visitor(&f->result, data);
+}
+
+static std::string future_repr(value)
+{
+    return "<#future>";
+}
+
+static metatype_t *future_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        future_destruct,
+        future_gc_visit,
+        future_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+bool is_future(value val)
+{
+    return object_metaobject(val) == future_metaobject();
+}
+
+void future_run(value f)
+{
+    auto data = object_data_as<future_t *>(f);
+    auto state = data->state;
+
+    int expected = future_pending;
+
+    if (!state->status.compare_exchange_strong(expected, future_running))
+        return;
+
+    try {
+        gc_store(&data->result, apply(data->proc, {}, data->args));
+    } catch (const noldor_exception &e) {
+        gc_store(&data->result, error_object_from_exception(e));
+        state->failed = true;
+    } catch (const std::exception &e) {
+        gc_store(&data->result, mk_error_object(mk_string(e.what()), list()));
+        state->failed = true;
+    }
+
+    gc_write_barrier(f);
+
+    {
+        std::lock_guard<std::mutex> lock(finished_mutex());
+        state->status.store(future_done);
+    }
+
+    finished_cv().notify_all();
+}
+
+value make_future(value proc, dot_tag, value args)
+{
+    check_type(is_procedure, proc, "make-future: expected procedure");
+
+    future_t f;
+    f.proc = proc;
+    f.args = args;
+
+    value self = object_allocate<future_t>(future_metaobject(), std::move(f));
+    work_pool_submit(self);
+
+    return self;
+}
+
+value touch(value f)
+{
+    check_type(is_future, f, "touch: expected future");
+
+    auto data = object_data_as<future_t *>(f);
+    auto state = data->state;
+
+    future_run(f);
+
+    // running elsewhere: lend a hand with other work while it finishes
+    while (state->status.load() != future_done) {
+        if (work_pool_help())
+            continue;
+
+        blocking_region blocking;
+        std::unique_lock<std::mutex> lock(finished_mutex());
+        finished_cv().wait(lock, [&state] { return state->status.load() == future_done; });
+    }
+
+    if (state->failed)
+        throw raise_error("touch: future raised", data->result);
+
+    return data->result;
+}
+
+value future_map(value proc, value lst)
+{
+    check_type(is_procedure, proc, "future-map: expected procedure");
+
+    value futures = list();
+    basic_scope roots { &futures };
+
+    for (; is_pair(lst); lst = cdr(lst))
+        futures = cons(make_future(proc, {}, list(car(lst))), futures);
+
+    futures = reverse(futures);
+
+    value results = list();
+    value f = futures;
+    basic_scope result_roots { &results, &f };
+
+    for (; is_pair(f); f = cdr(f))
+        results = cons(touch(car(f)), results);
+
+    return reverse(results);
+}
+
+}
@@ -0,0 +1,188 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <thread>
+
+namespace noldor {
+
+// Each isolate runs on an OS thread of its own with a fresh heap and global
+// environment. It starts from a copy of a procedure expression and its
+// arguments, and hands back a copy of the result.
+
+struct isolate_state {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    bool failed = false;
+    bool error_object = false;  // failed, and result is message and irritants
+    message_t result;           // value, or raised object if failed
+};
+
+struct isolate_handle_t {
+    std::shared_ptr<isolate_state> state;
+};
+
+static void isolate_destruct(value self)
+{
+    object_data_as<isolate_handle_t *>(self)->~isolate_handle_t();
+}
+
+static std::string isolate_repr(value)
+{
+    return "<#isolate>";
+}
+
+static metatype_t *isolate_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        isolate_destruct,
+        nullptr,
+        isolate_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+bool is_isolate(value val)
+{
+    return object_metaobject(val) == isolate_metaobject();
+}
+
+// the heap goes last, after the thread's allocation buffers, mutator and
+// scheduler that still point into it
+struct isolate_owner {
+    std::unique_ptr<isolate_t> isolate { new isolate_t };
+};
+
+static void wait_for_os_threads(isolate_t *isolate)
+{
+    blocking_region blocking;
+    std::unique_lock<std::mutex> lock(isolate->world_mutex);
+    isolate->world_cv.wait(lock, [isolate] { return isolate->n_mutators.load() == 1; });
+}
+
+// error objects are rebuilt from their parts, anything else that cannot be
+// copied is reported by message
+static message_t failure_message(const std::exception &e, bool &error_object)
+{
+    value raised = mk_error_object(mk_string(e.what()), list());
+
+    if (auto err = dynamic_cast<const noldor_exception *>(&e))
+        raised = error_object_from_exception(*err);
+
+    error_object = is_error_object(raised);
+
+    try {
+        if (error_object)
+            return message_from(cons(error_object_message(raised), error_object_irritants(raised)));
+
+        return message_from(raised);
+    } catch (const noldor_exception &) {
+        error_object = true;
+        return message_from(list(mk_string(e.what())));
+    }
+}
+
+static void isolate_main(message_t start, std::shared_ptr<isolate_state> state)
+{
+    static thread_local isolate_owner owner;
+
+    globals::set_isolate(owner.isolate.get());
+    attach_mutator();
+    init_isolate();
+
+    message_t result;
+    bool failed = false;
+    bool error_object = false;
+
+    try {
+        value call = message_value(start);
+        basic_scope roots { &call };
+
+        value proc = eval(car(call), interaction_environment());
+        result = message_from(apply(proc, {}, cdr(call)));
+    } catch (const std::exception &e) {
+        result = failure_message(e, error_object);
+        failed = true;
+    }
+
+    work_pool_shutdown();
+    wait_for_os_threads(owner.isolate.get());
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->result = std::move(result);
+        state->failed = failed;
+        state->error_object = error_object;
+        state->done = true;
+    }
+
+    state->cv.notify_all();
+}
+
+value make_isolate(value proc, dot_tag, value args)
+{
+    message_t start = message_from(cons(proc, args));
+    auto state = std::make_shared<isolate_state>();
+
+    try {
+        std::thread(isolate_main, std::move(start), state).detach();
+    } catch (const std::system_error &e) {
+        throw runtime_error(std::string("make-isolate: ") + e.what());
+    }
+
+    return object_allocate<isolate_handle_t>(isolate_metaobject(), isolate_handle_t { std::move(state) });
+}
+
+value isolate_join(value iso)
+{
+    check_type(is_isolate, iso, "isolate-join!: expected isolate");
+
+    auto state = object_data_as<isolate_handle_t *>(iso)->state;
+
+    {
+        blocking_region blocking;
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&state] { return state->done; });
+    }
+
+    value result = message_value(state->result);
+
+    if (state->error_object)
+        result = mk_error_object(car(result), cdr(result));
+
+    if (state->failed)
+        throw raise_error("isolate-join!: isolate raised", result);
+
+    return result;
+}
+
+}
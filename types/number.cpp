@@ -94,23 +94,23 @@ template <>
 struct unary_numeric_op<reflect_operant> {
     static bool is_zero(value a)
     {
-        throw noldor::type_error("unimplemented: (zero? " + printable(a) + ")", a);
+        throw noldor::type_error("unimplemented: zero?", a);
     }
     static bool is_positive(value a)
     {
-        throw noldor::type_error("unimplemented: (positive? " + printable(a) + ")", a);
+        throw noldor::type_error("unimplemented: positive?", a);
     }
     static bool is_negative(value a)
     {
-        throw noldor::type_error("unimplemented: (negative? " + printable(a) + ")", a);
+        throw noldor::type_error("unimplemented: negative?", a);
     }
     static bool is_odd(value a)
     {
-        throw noldor::type_error("unimplemented: (odd? " + printable(a) + ")", a);
+        throw noldor::type_error("unimplemented: odd?", a);
     }
     static bool is_even(value a)
     {
-        throw noldor::type_error("unimplemented: (even? " + printable(a) + ")", a);
+        throw noldor::type_error("unimplemented: even?", a);
     }
 };
 
@@ -166,47 +166,47 @@ struct binary_numeric_op<LeftT, RightT>
 {
     static value add(value a, value b)
     {
-        throw noldor::type_error("cannot compute (+ " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute +", list(a, b));
     }
 
     static value sub(value a, value b)
     {
-        throw noldor::type_error("cannot compute (- " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute -", list(a, b));
     }
 
     static value mul(value a, value b)
     {
-        throw noldor::type_error("cannot compute (* " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute *", list(a, b));
     }
 
     static value div(value a, value b)
     {
-        throw noldor::type_error("cannot compute (/ " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute /", list(a, b));
     }
 
     static value equals(value a, value b)
     {
-        throw noldor::type_error("cannot compute (= " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute =", list(a, b));
     }
 
     static value st(value a, value b)
     {
-        throw noldor::type_error("cannot compute (< " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute <", list(a, b));
     }
 
     static value gt(value a, value b)
     {
-        throw noldor::type_error("cannot compute (> " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute >", list(a, b));
     }
 
     static value ste(value a, value b)
     {
-        throw noldor::type_error("cannot compute (<= " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute <=", list(a, b));
     }
 
     static value gte(value a, value b)
     {
-        throw noldor::type_error("cannot compute (>= " + printable(a) + " " + printable(b) + " )", list(a, b));
+        throw noldor::type_error("cannot compute >=", list(a, b));
     }
 };
 
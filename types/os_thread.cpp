@@ -0,0 +1,173 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <condition_variable>
+#include <sstream>
+#include <thread>
+
+namespace noldor {
+
+// OS threads share the heap with every other thread of their isolate; each
+// runs its thunk in its own interpreter run with its own green thread
+// scheduler.
+
+struct os_thread_state {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool started = false;   // the thread has rooted itself
+    bool done = false;
+};
+
+struct os_thread_t {
+    value thunk = list();
+    value result = list();  // value, or raised object if failed
+    bool failed = false;
+    std::shared_ptr<os_thread_state> state = std::make_shared<os_thread_state>();
+};
+
+static void os_thread_destruct(value self)
+{
+    object_data_as<os_thread_t *>(self)->~os_thread_t();
+}
+
+static void os_thread_gc_visit(value self, gc_visit_fn_t visitor, void *data)
+{
+    auto t = object_data_as<os_thread_t *>(self);
+    visitor(&t->thunk, data);
+    visitor(&t->result, data);
+}
+
+static std::string os_thread_repr(value)
+{
+    return "<#os-thread>";
+}
+
+static metatype_t *os_thread_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        os_thread_destruct,
+        os_thread_gc_visit,
+        os_thread_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+bool is_os_thread(value val)
+{
+    return object_metaobject(val) == os_thread_metaobject();
+}
+
+static void os_thread_main(isolate_t *isolate, value self)
+{
+    globals::set_isolate(isolate);
+    attach_mutator();
+    basic_scope roots { &self };
+
+    auto data = object_data_as<os_thread_t *>(self);
+    auto state = data->state;
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->started = true;
+    }
+
+    state->cv.notify_all();
+
+    try {
+        gc_store(&data->result, apply(data->thunk, {}, list()));
+    } catch (const noldor_exception &e) {
+        gc_store(&data->result, error_object_from_exception(e));
+        data->failed = true;
+    } catch (const std::exception &e) {
+        gc_store(&data->result, mk_error_object(mk_string(e.what()), list()));
+        data->failed = true;
+    }
+
+    gc_write_barrier(self);
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->done = true;
+    }
+
+    state->cv.notify_all();
+}
+
+value make_os_thread(value thunk)
+{
+    check_type(is_procedure, thunk, "make-os-thread: expected procedure");
+
+    os_thread_t t;
+    t.thunk = thunk;
+
+    value self = object_allocate<os_thread_t>(os_thread_metaobject(), std::move(t));
+    basic_scope roots { &self };
+
+    auto state = object_data_as<os_thread_t *>(self)->state;
+
+    try {
+        std::thread(os_thread_main, globals::isolate(), self).detach();
+    } catch (const std::system_error &e) {
+        throw runtime_error(std::string("make-os-thread: ") + e.what());
+    }
+
+    // the new thread attaches to the heap before it roots itself, which may
+    // mean waiting out a collection; self stays rooted here until then
+    {
+        blocking_region blocking;
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&state] { return state->started; });
+    }
+
+    return self;
+}
+
+value os_thread_join(value t)
+{
+    check_type(is_os_thread, t, "os-thread-join!: expected os thread");
+
+    auto data = object_data_as<os_thread_t *>(t);
+    auto state = data->state;
+
+    {
+        blocking_region blocking;
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&state] { return state->done; });
+    }
+
+    if (data->failed)
+        throw raise_error("os-thread-join!: thread raised", data->result);
+
+    return data->result;
+}
+
+}
@@ -28,6 +28,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <poll.h>
 #include <cassert>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <algorithm>
 
@@ -41,10 +45,19 @@ enum : unsigned {
     port_textual = 0x10,
     port_binary  = 0x20,
     port_open    = 0x40,
-    port_noclose = 0x80
+    port_noclose = 0x80,
+    port_socket  = 0x100,
+    port_listener = 0x200,
+    port_unix    = 0x400
 };
 
+static const size_t SOCKET_BUFFER_SIZE = 4096;
+
 struct port_t {
+    port_t(unsigned flags, int fd, std::string strdata, std::vector<uint32_t> buffer)
+        : flags(flags), fd(fd), strdata(std::move(strdata)), buffer(std::move(buffer))
+    {}
+
     port_t(const port_t &) = delete;
     port_t(port_t &&) = default;
     ~port_t();
@@ -55,6 +68,10 @@ struct port_t {
     int fd = -1;
     std::string strdata; // filename if flags & port_file, data if flags & port_string
     std::vector<uint32_t> buffer; // pusback buffer
+
+    std::string inbuf;  // sockets only, bytes received but not yet read
+    size_t inpos = 0;
+    std::string outbuf; // sockets only, bytes written but not yet sent
 };
 
 port_t::~port_t()
@@ -77,6 +94,12 @@ bool port_t::close_port()
         fd = -1;
     }
 
+    if ((flags & port_listener) && (flags & port_unix))
+        unlink(strdata.c_str());
+
+    inbuf.clear();
+    outbuf.clear();
+
     if (flags & port_string)
         strdata.clear();
 
@@ -84,12 +107,34 @@ bool port_t::close_port()
     return true;
 }
 
+// A port that dies open is closed by its finalizer right after the
+// collection; only those left when the isolate goes away close here.
 static void port_destruct(value port)
 {
     object_data_as<port_t *>(port)->close_port();
     object_data_as<port_t *>(port)->~port_t();
 }
 
+static bool send_buffered(value port);
+
+// runs with the world started again, on whichever thread collected, so a
+// dropped socket gets one send of what was written to it that does not
+// wait for its peer; there is nobody left to raise a failure to
+static void port_finalize(value port)
+{
+    auto data = object_data_as<port_t *>(port);
+
+    if ((data->flags & port_socket) && (data->flags & port_open) && (data->flags & port_output)) {
+        try {
+            send_buffered(port);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "%s\n", e.what());
+        }
+    }
+
+    data->close_port();
+}
+
 static void port_gc_visit(value, gc_visit_fn_t, void*)
 {}
 
@@ -104,6 +149,8 @@ static std::string port_repr(value port)
         repr << " " << data->strdata << " fd " << data->fd << " ";
     if (data->flags & port_string)
         repr << " stringbuf ";
+    if (data->flags & port_socket)
+        repr << (data->flags & port_listener ? "listener " : "socket ");
     if (data->flags & port_open)
         repr << "open ";
     if (data->flags & port_noclose)
@@ -127,7 +174,8 @@ static metatype_t *port_metaobject()
         typeflags_none,
         port_destruct,
         port_gc_visit,
-        port_repr
+        port_repr,
+        type_tag_port
     };
 
     return &metaobject;
@@ -155,7 +203,7 @@ bool is_binary_port(value val)
 
 bool is_port(value val)
 {
-    return object_metaobject(val) == port_metaobject();
+    return magic::has_type_tag(val, type_tag_port);
 }
 
 bool is_input_port_open(value val)
@@ -214,18 +262,542 @@ static value open_file(std::string filename, int oflag)
         throw file_error(strerror(errno), mk_string(std::move(filename)));
     }
 
-    return object_allocate<port_t>(port_metaobject(),
-                                   port_t { port_file | port_open | port_flags(oflag),
-                                            fd, std::move(filename), {} });
+    value port = object_allocate<port_t>(port_metaobject(),
+                                         port_t { port_file | port_open | port_flags(oflag),
+                                                  fd, std::move(filename), {} });
+    gc_register_finalizer(port, port_finalize);
+    return port;
+}
+
+static void set_fd_nonblocking(int fd, bool nonblock)
+{
+    int fl = fcntl(fd, F_GETFL);
+    if (fl == -1 || fcntl(fd, F_SETFL, nonblock ? fl | O_NONBLOCK : fl & ~O_NONBLOCK) == -1)
+        throw file_error(std::string("fcntl: ") + strerror(errno), mk_int(fd));
 }
 
 value mk_port_from_fd(int fd, int oflag)
 {
+    if (oflag & O_NONBLOCK)
+        set_fd_nonblocking(fd, true);
+
     return object_allocate<port_t>(port_metaobject(),
                                    port_t { port_file | port_open | port_noclose | port_flags(oflag),
                                             fd, "", {} });
 }
 
+int port_fd(value port)
+{
+    return is_file_port(port) ? object_data_as<port_t *>(port)->fd : -1;
+}
+
+// the mode lives on the fd, so every port sharing it sees the change
+bool is_port_blocking(value port)
+{
+    check_type(is_port, port, "port-blocking?: expected port");
+    auto data = object_data_as<port_t *>(port);
+
+    return data->fd == -1 || (fcntl(data->fd, F_GETFL) & O_NONBLOCK) == 0;
+}
+
+value set_port_blocking(value port, value blocking_val)
+{
+    bool blocking = !is_false(blocking_val);
+    check_type(is_port, port, "set-port-blocking!: expected port");
+    auto data = object_data_as<port_t *>(port);
+
+    if (data->fd != -1)
+        set_fd_nonblocking(data->fd, !blocking);
+
+    return port;
+}
+
+static void wait_fd(int fd, short events)
+{
+    int result;
+    struct pollfd pfd = { fd, events, 0 };
+    EINTR_SAFE(result, ::poll, &pfd, 1, -1);
+}
+
+// With other OS threads on the heap, a wait lets them collect meanwhile.
+// The port is held and pinned across it, since its data is used after.
+static void wait_port(value port, short events)
+{
+    int fd = object_data_as<port_t *>(port)->fd;
+
+    if (!is_multithreaded()) {
+        wait_fd(fd, events);
+        return;
+    }
+
+    basic_scope sc {&port};
+    pin_scope pin(port);
+    blocking_region blocking;
+    wait_fd(fd, events);
+}
+
+// parks the green thread, or waits for the fd on this OS thread; only
+// called before anything has been read
+static void wait_port_readable(value port)
+{
+    scheduler_wait_readable(object_data_as<port_t *>(port)->fd);
+
+    if (is_multithreaded())
+        wait_port(port, POLLIN);
+}
+
+#if defined(MSG_NOSIGNAL)
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+static ssize_t write_some(port_t *data, const char *bytes, size_t size)
+{
+    ssize_t result;
+
+    if (data->flags & port_socket) {
+        EINTR_SAFE(result, ::send, data->fd, bytes, size, SEND_FLAGS | MSG_DONTWAIT);
+    } else {
+        EINTR_SAFE(result, ::write, data->fd, bytes, size);
+    }
+
+    return result;
+}
+
+static bool is_would_block(ssize_t result)
+{
+    return result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// sends as much of the buffer as the socket takes without waiting, and
+// returns whether all of it went
+static bool send_buffered(value port)
+{
+    auto data = object_data_as<port_t *>(port);
+
+    while (!data->outbuf.empty()) {
+        ssize_t result = write_some(data, data->outbuf.data(), data->outbuf.size());
+
+        if (is_would_block(result))
+            return false;
+
+        if (result == -1) {
+            data->outbuf.clear();
+            throw file_error(std::string("flush: ") + strerror(errno), port);
+        }
+
+        data->outbuf.erase(0, size_t(result));
+    }
+
+    return true;
+}
+
+// Sends everything buffered. On a full send queue a primitive that can be
+// retried parks its green thread, and picks up from what is left when it
+// runs again; other callers wait for the socket right here.
+static void flush_socket(value port, bool may_park)
+{
+    while (!send_buffered(port)) {
+        if (may_park)
+            scheduler_wait_writable(object_data_as<port_t *>(port)->fd);
+
+        wait_port(port, POLLOUT);
+    }
+}
+
+static ssize_t read_some(port_t *data, char *c)
+{
+    for (;;) {
+        ssize_t result;
+
+        if (data->flags & port_socket) {
+            data->inbuf.resize(SOCKET_BUFFER_SIZE);
+            data->inpos = 0;
+
+            EINTR_SAFE(result, ::recv, data->fd, &data->inbuf[0], SOCKET_BUFFER_SIZE, 0);
+            data->inbuf.resize(result > 0 ? size_t(result) : 0);
+
+            if (result > 0) {
+                *c = data->inbuf[data->inpos++];
+                return 1;
+            }
+        } else {
+            EINTR_SAFE(result, ::read, data->fd, c, 1);
+        }
+
+        if (!is_would_block(result))
+            return result;
+
+        wait_fd(data->fd, POLLIN);
+    }
+}
+
+// a non-blocking fd with nothing to read is waited on right here: readers
+// that get this far have already parked once or are in the middle of a datum.
+// The read itself may block too, so other OS threads may collect during it.
+static ssize_t read_byte(value port, char *c)
+{
+    auto data = object_data_as<port_t *>(port);
+
+    if ((data->flags & port_socket) && data->inpos < data->inbuf.size()) {
+        *c = data->inbuf[data->inpos++];
+        return 1;
+    }
+
+    // a peer waiting for our request before it answers would deadlock us
+    if ((data->flags & port_socket) && !data->outbuf.empty())
+        flush_socket(port, false);
+
+    if (!is_multithreaded())
+        return read_some(data, c);
+
+    basic_scope sc {&port};
+    pin_scope pin(port);
+    blocking_region blocking;
+    return read_some(data, c);
+}
+
+// parks the green thread when nothing has been written yet, so the whole
+// primitive can be retried; past that the rest is written blocking. Sockets
+// buffer output until it fills up, is flushed, or the socket is read from;
+// a buffer left full is flushed before the next write adds to it.
+static void write_all(value port, std::string repr)
+{
+    auto data = object_data_as<port_t *>(port);
+
+    if (data->flags & port_socket) {
+        if (data->outbuf.size() >= SOCKET_BUFFER_SIZE)
+            flush_socket(port, true);
+
+        data->outbuf += repr;
+
+        if (data->outbuf.size() >= SOCKET_BUFFER_SIZE)
+            send_buffered(port);
+
+        return;
+    }
+
+    bool written = false;
+
+    while (repr.size()) {
+        ssize_t result = write_some(data, repr.data(), repr.size());
+
+        if (is_would_block(result)) {
+            if (!written)
+                scheduler_wait_writable(data->fd);
+
+            wait_port(port, POLLOUT);
+            continue;
+        }
+
+        if (result == -1) {
+            perror("write");
+            throw file_error(strerror(errno), port);
+        }
+
+        written = true;
+        repr.erase(0, size_t(result));
+    }
+}
+
+value flush_output_port(dot_tag, value portl)
+{
+    value port = is_null(portl) ? current_output_port() : car(portl);
+    check_type(is_output_port, port, "flush-output-port: expected output port");
+
+    if (is_file_port(port) && (object_data_as<port_t *>(port)->flags & port_socket))
+        flush_socket(port, true);
+
+    return port;
+}
+
+static value mk_socket_port(int fd, unsigned flags, std::string name)
+{
+    value port = object_allocate<port_t>(port_metaobject(),
+                                         port_t { port_file | port_socket | port_open | flags,
+                                                  fd, std::move(name), {} });
+    gc_register_finalizer(port, port_finalize);
+    return port;
+}
+
+static value mk_stream_port(int fd, unsigned flags, std::string name)
+{
+    return mk_socket_port(fd, flags | port_input | port_output | port_binary | port_textual, std::move(name));
+}
+
+[[noreturn]] static void socket_error(const char *what, std::string name, int fd = -1)
+{
+    std::string message = std::string(what) + ": " + strerror(errno);
+
+    if (fd != -1)
+        close(fd);
+
+    throw file_error(message, mk_string(std::move(name)));
+}
+
+static std::string host_port_name(const std::string &host, int32_t port)
+{
+    return host + ":" + std::to_string(port);
+}
+
+// host "" binds every interface
+static struct addrinfo *tcp_addresses(const std::string &host, int32_t port, bool listening)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    struct addrinfo *addrs = nullptr;
+    int err = getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(), &hints, &addrs);
+
+    if (err != 0)
+        throw file_error(std::string("getaddrinfo: ") + gai_strerror(err), mk_string(host_port_name(host, port)));
+
+    return addrs;
+}
+
+static int tcp_listen(const std::string &host, int32_t port)
+{
+    struct addrinfo *addrs = tcp_addresses(host, port, true);
+
+    int fd = -1;
+    int saved_errno = 0;
+
+    for (struct addrinfo *ai = addrs; ai && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd == -1) {
+            saved_errno = errno;
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1 || listen(fd, SOMAXCONN) == -1) {
+            saved_errno = errno;
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    freeaddrinfo(addrs);
+    errno = saved_errno;
+
+    return fd;
+}
+
+value make_tcp_listener(int32_t port, dot_tag, value hostl)
+{
+    std::string host = is_null(hostl) ? "" : string_get(car(hostl));
+
+    int fd = tcp_listen(host, port);
+    if (fd == -1)
+        socket_error("make-tcp-listener", host_port_name(host, port));
+
+    return mk_socket_port(fd, port_listener, host_port_name(host, port));
+}
+
+// the socket of a connect that parked its green thread, once it is done
+static int finish_connect(value pending)
+{
+    int fd = object_data_as<port_t *>(pending)->fd;
+    int err = 0;
+    socklen_t size = sizeof(err);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &size) == -1)
+        err = errno;
+
+    if (err == 0 && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) == -1)
+        err = errno;
+
+    return err;
+}
+
+// Tries each address in turn. A green thread that can park connects without
+// blocking, and parks on a connect still in progress; the socket stays on
+// the thread with the index of its address, and the retried primitive goes
+// on from there. Anywhere else the connect blocks the OS thread.
+value tcp_connect(std::string host, int32_t port)
+{
+    std::string name = host_port_name(host, port);
+    std::unique_ptr<struct addrinfo, void (*)(struct addrinfo *)> addrs(tcp_addresses(host, port, false), freeaddrinfo);
+
+    green_thread_t *thread = scheduler_can_park() ? green_thread_data(current_thread()) : nullptr;
+    size_t index = 0;
+    int saved_errno = 0;
+
+    if (thread && is_port(thread->connecting)) {
+        value pending = thread->connecting;
+        index = thread->connecting_address;
+        thread->connecting = list();
+
+        saved_errno = finish_connect(pending);
+        if (saved_errno == 0)
+            return pending;
+
+        object_data_as<port_t *>(pending)->close_port();
+        ++index;
+    }
+
+    struct addrinfo *ai = addrs.get();
+    for (size_t i = 0; ai && i < index; ++i)
+        ai = ai->ai_next;
+
+    for (; ai; ai = ai->ai_next, ++index) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | (thread ? SOCK_NONBLOCK : 0), ai->ai_protocol);
+        if (fd == -1) {
+            saved_errno = errno;
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        int result;
+
+        if (thread) {
+            // an interrupted connect goes on in the background too
+            result = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+
+            if (result == -1 && (errno == EINPROGRESS || errno == EINTR)) {
+                thread->connecting = mk_stream_port(fd, 0, name);
+                thread->connecting_address = index;
+                throw green_thread_park { fd, POLLOUT };
+            }
+
+            if (result == 0 && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) == -1)
+                result = -1;
+        } else {
+            blocking_region blocking;
+            EINTR_SAFE(result, ::connect, fd, ai->ai_addr, ai->ai_addrlen);
+        }
+
+        if (result == 0)
+            return mk_stream_port(fd, 0, name);
+
+        saved_errno = errno;
+        close(fd);
+    }
+
+    errno = saved_errno;
+    socket_error("tcp-connect", name);
+}
+
+static struct sockaddr_un unix_address(const std::string &path)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(addr.sun_path))
+        throw file_error("unix socket path too long", mk_string(path));
+
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+value make_unix_listener(std::string path)
+{
+    struct sockaddr_un addr = unix_address(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        socket_error("make-unix-listener", path);
+
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1
+            || listen(fd, SOMAXCONN) == -1)
+        socket_error("make-unix-listener", path, fd);
+
+    return mk_socket_port(fd, port_listener | port_unix, std::move(path));
+}
+
+value unix_connect(std::string path)
+{
+    struct sockaddr_un addr = unix_address(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        socket_error("unix-connect", path);
+
+    // only waits on a full backlog, and is not worth parking for
+    int result;
+    {
+        blocking_region blocking;
+        EINTR_SAFE(result, ::connect, fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    }
+
+    if (result == -1)
+        socket_error("unix-connect", path, fd);
+
+    return mk_stream_port(fd, port_unix, std::move(path));
+}
+
+static bool is_listener(value val)
+{
+    return is_port(val) && object_data_as<port_t *>(val)->flags & port_listener;
+}
+
+bool is_socket_port(value val)
+{
+    return is_port(val) && object_data_as<port_t *>(val)->flags & port_socket;
+}
+
+// parks until a connection is pending, like a read; accepted sockets
+// start out blocking whatever the listener's mode
+value socket_accept(value listener)
+{
+    check_type(is_listener, listener, "accept: expected listener");
+    auto data = object_data_as<port_t *>(listener);
+
+    if ((data->flags & port_open) == 0)
+        throw file_error("accept: listener is closed", listener);
+
+    wait_port_readable(listener);
+
+    for (;;) {
+        int fd;
+        EINTR_SAFE(fd, ::accept, data->fd, nullptr, nullptr);
+
+        if (fd != -1) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            set_fd_nonblocking(fd, false);
+
+            if ((data->flags & port_unix) == 0) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+
+            return mk_stream_port(fd, data->flags & port_unix, data->strdata);
+        }
+
+        if (!is_would_block(-1) && errno != ECONNABORTED)
+            socket_error("accept", data->strdata);
+
+        wait_port(listener, POLLIN);
+    }
+}
+
+// the bound port, useful after listening on port 0
+int32_t listener_port(value listener)
+{
+    check_type(is_listener, listener, "listener-port: expected listener");
+
+    struct sockaddr_storage addr;
+    socklen_t size = sizeof(addr);
+
+    if (getsockname(object_data_as<port_t *>(listener)->fd, reinterpret_cast<struct sockaddr *>(&addr), &size) == -1)
+        socket_error("listener-port", object_data_as<port_t *>(listener)->strdata);
+
+    if (addr.ss_family == AF_INET)
+        return ntohs(reinterpret_cast<struct sockaddr_in *>(&addr)->sin_port);
+
+    if (addr.ss_family == AF_INET6)
+        return ntohs(reinterpret_cast<struct sockaddr_in6 *>(&addr)->sin6_port);
+
+    throw type_error("listener-port: not a tcp listener", listener);
+}
+
 value open_input_file(std::string filename)
 {
     value val = open_file(std::move(filename), O_RDONLY);
@@ -254,21 +826,68 @@ value open_binary_output_file(std::string filename)
     return val;
 }
 
+// buffered output goes out before the socket closes, even if sending fails
+static bool close_socket(value val)
+{
+    auto data = object_data_as<port_t *>(val);
+
+    try {
+        if ((data->flags & port_open) && (data->flags & port_output))
+            flush_socket(val, true);
+    } catch (const green_thread_park &) {
+        throw;
+    } catch (...) {
+        data->close_port();
+        throw;
+    }
+
+    return data->close_port();
+}
+
+// closes one direction of a socket, the whole socket once both are gone
+static bool shutdown_socket(value val, unsigned direction)
+{
+    auto data = object_data_as<port_t *>(val);
+
+    if ((data->flags & port_open) == 0 || (data->flags & (port_input | port_output)) == direction)
+        return close_socket(val);
+
+    if (direction == port_output)
+        flush_socket(val, true);
+
+    shutdown(data->fd, direction == port_input ? SHUT_RD : SHUT_WR);
+    data->flags &= ~direction;
+
+    return true;
+}
+
 bool close_port(value val)
 {
     check_type(is_port, val, "close_port: expected port");
+
+    if (is_socket_port(val))
+        return close_socket(val);
+
     return object_data_as<port_t *>(val)->close_port();
 }
 
 bool close_input_port(value val)
 {
     check_type(is_input_port, val, "close_input_port: expected input port");
+
+    if (is_socket_port(val))
+        return shutdown_socket(val, port_input);
+
     return object_data_as<port_t *>(val)->close_port();
 }
 
 bool close_output_port(value val)
 {
     check_type(is_output_port, val, "close_output_port: expected output port");
+
+    if (is_socket_port(val))
+        return shutdown_socket(val, port_output);
+
     return object_data_as<port_t *>(val)->close_port();
 }
 
@@ -320,6 +939,22 @@ static value get_input_port(std::string fname, value portl)
     return val;
 }
 
+// lets other green threads run until reading from port would not block
+static value wait_until_readable(value port)
+{
+    if (is_file_port(port) && is_input_port_open(port)) {
+        auto data = object_data_as<port_t *>(port);
+
+        if ((data->flags & port_socket) && !data->outbuf.empty())
+            flush_socket(port, true);
+
+        if (data->buffer.empty() && data->inpos >= data->inbuf.size())
+            wait_port_readable(port);
+    }
+
+    return port;
+}
+
 static bool is_symbol_initial(int c)
 {
     return isalpha(c) || strchr("!$%&*/:<=>?^_~@", c);
@@ -444,7 +1079,7 @@ static std::vector<value> read_list_or_vector(value port)
 value read(dot_tag, value portl)
 {
     value port = get_input_port("read", portl);
-    return read(port);
+    return read(wait_until_readable(port));
 }
 
 value read(value port)
@@ -665,7 +1300,7 @@ value read_char(value port)
     if (is_file_port(port)) {
         char c;
 
-        switch (::read(data->fd, &c, 1)) {
+        switch (read_byte(port, &c)) {
         case 0:
             return mk_eof_object();
         case 1:
@@ -683,7 +1318,7 @@ value read_char(value port)
 
 value read_char(dot_tag, value portl)
 {
-    return read_char(get_input_port("read_char", portl));
+    return read_char(wait_until_readable(get_input_port("read_char", portl)));
 }
 
 value peek_char(value port)
@@ -703,7 +1338,7 @@ value peek_char(value port)
 
 value peek_char(dot_tag, value portl)
 {
-    return peek_char(get_input_port("peek_char", portl));
+    return peek_char(wait_until_readable(get_input_port("peek_char", portl)));
 }
 
 value read_line(value port)
@@ -729,10 +1364,10 @@ value read_line(value port)
         char c;
         ssize_t result;
 
-        while ((result = ::read(data->fd, &c, 1)) == 1 && c != '\n')
+        while ((result = read_byte(port, &c)) == 1 && c != '\n')
             line += c;
 
-        if (line.size() > 0)
+        if (line.size() > 0 || result == 1)
             return mk_string(line);
 
         if (result == 0)
@@ -746,7 +1381,7 @@ value read_line(value port)
 
 value read_line(dot_tag, value portl)
 {
-    return read_line(get_input_port("read_line", portl));
+    return read_line(wait_until_readable(get_input_port("read_line", portl)));
 }
 
 bool is_char_ready(value port)
@@ -756,6 +1391,9 @@ bool is_char_ready(value port)
 
     auto data = object_data_as<port_t *>(port);
 
+    if (data->buffer.size() > 0 || data->inpos < data->inbuf.size())
+        return true;
+
     if (is_string_port(port))
         return data->strdata.size() > 0;
 
@@ -782,7 +1420,7 @@ bool is_char_ready(dot_tag, value portl)
 value write(value obj, dot_tag, value port)
 {
     port = is_null(port) ? current_output_port()
-                         : cadr(port);
+                         : car(port);
 
     check_type(is_output_port, port, "write: expected output port");
 
@@ -792,15 +1430,7 @@ value write(value obj, dot_tag, value port)
     if (is_string_port(port)) {
         data->strdata += repr;
     } else if (is_file_port(port)) {
-        while (repr.size()) {
-            int result;
-            EINTR_SAFE(result, ::write, data->fd, repr.data(), repr.size());
-
-            if (result == -1) {
-                perror("write");
-                throw file_error(strerror(errno), port);
-            }
-        }
+        write_all(port, std::move(repr));
     }
 
     return obj;
@@ -809,7 +1439,7 @@ value write(value obj, dot_tag, value port)
 value display(value obj, dot_tag, value port)
 {
     port = is_null(port) ? current_output_port()
-                         : cadr(port);
+                         : car(port);
 
     check_type(is_output_port, port, "display: expected output port");
 
@@ -819,15 +1449,7 @@ value display(value obj, dot_tag, value port)
     if (is_string_port(port)) {
         data->strdata += repr;
     } else if (is_file_port(port)) {
-        while (repr.size()) {
-            int result;
-            EINTR_SAFE(result, ::write, data->fd, repr.data(), repr.size());
-
-            if (result == -1) {
-                perror("write");
-                throw file_error(strerror(errno), port);
-            }
-        }
+        write_all(port, std::move(repr));
     }
 
     return obj;
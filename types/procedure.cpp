@@ -23,9 +23,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 */
 
-#include "noldor.h"
+#include "noldor_impl.h"
 #include <functional>
 #include <sstream>
+#include <algorithm>
 
 namespace noldor {
 
@@ -63,7 +64,8 @@ static metatype_t *primitive_procedure_metaobject()
         typeflags_none,
         primitive_procedure_destruct,
         primitive_procedure_gc_visit,
-        primitive_procedure_repr
+        primitive_procedure_repr,
+        type_tag_primitive_procedure
     };
 
     return &metaobject;
@@ -76,7 +78,7 @@ value mk_primitive_procedure(std::string name, value (*fptr)(value))
 
 bool is_primitive_procedure(value val)
 {
-    return object_metaobject(val) == primitive_procedure_metaobject();
+    return magic::has_type_tag(val, type_tag_primitive_procedure);
 }
 
 value apply_primitive_procedure(value self, value argl)
@@ -121,7 +123,8 @@ static metatype_t *compound_function_metaobject()
         typeflags_none,
         compound_function_destruct,
         compound_function_gc_visit,
-        compound_function_repr
+        compound_function_repr,
+        type_tag_compound_procedure
     };
 
     return &metaobject;
@@ -134,7 +137,7 @@ value mk_procedure(value parameters, value body, value env)
 
 bool is_compound_procedure(value proc)
 {
-    return object_metaobject(proc) == compound_function_metaobject();
+    return magic::has_type_tag(proc, type_tag_compound_procedure);
 }
 
 value procedure_parameters(value proc)
@@ -155,9 +158,195 @@ value procedure_body(value proc)
     return object_data_as<compound_procedure_t *>(proc)->body;
 }
 
+// case-lambda: one compound procedure per clause plus an arity table that
+// maps an argument count straight to the clause it selects
+
+struct case_lambda_t {
+    value environment = list();
+    std::vector<value> clauses;
+    std::vector<uint16_t> by_argc; // clause index + 1, 0 if no clause matches
+    uint16_t rest_clause = 0;      // clause index + 1 for argc >= by_argc.size()
+};
+
+static void case_lambda_destruct(value val)
+{
+    object_data_as<case_lambda_t *>(val)->~case_lambda_t();
+}
+
+static void case_lambda_gc_visit(value val, gc_visit_fn_t visitor, void *data)
+{
+    auto proc = object_data_as<case_lambda_t *>(val);
+    visitor(&proc->environment, data);
+
+    for (value &clause : proc->clauses)
+        visitor(&clause, data);
+}
+
+static std::string case_lambda_repr(value val)
+{
+    std::stringstream stream;
+    stream << "(case-lambda";
+
+    for (value clause : object_data_as<case_lambda_t *>(val)->clauses)
+        stream << " " << cons(procedure_parameters(clause), procedure_body(clause));
+
+    stream << ")";
+    return stream.str();
+}
+
+static metatype_t *case_lambda_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        case_lambda_destruct,
+        case_lambda_gc_visit,
+        case_lambda_repr,
+        type_tag_case_lambda
+    };
+
+    return &metaobject;
+}
+
+static void formals_arity(value formals, size_t *required, bool *has_rest)
+{
+    *required = 0;
+    *has_rest = false;
+
+    while (is_pair(formals)) {
+        if (eq(car(formals), SYMBOL_LITERAL(.))) {
+            *has_rest = true;
+            return;
+        }
+
+        *required += 1;
+        formals = cdr(formals);
+    }
+
+    *has_rest = !is_null(formals);
+}
+
+value mk_case_lambda(value clauses, value env)
+{
+    case_lambda_t proc;
+    proc.environment = env;
+
+    basic_scope scope { &clauses, &env };
+
+    std::vector<std::pair<size_t, bool>> arities;
+    proc.clauses.reserve(size_t(length(clauses)));
+
+    for (; !is_null(clauses); clauses = cdr(clauses)) {
+        check_type(is_pair, car(clauses), "case-lambda: expected (formals body...) clause");
+
+        size_t required;
+        bool has_rest;
+        formals_arity(caar(clauses), &required, &has_rest);
+
+        arities.emplace_back(required, has_rest);
+        proc.clauses.push_back(mk_procedure(caar(clauses), cdar(clauses), env));
+        scope.variables.push_back(&proc.clauses.back());
+    }
+
+    size_t table_size = 0;
+    for (auto &arity : arities)
+        table_size = std::max(table_size, arity.first + 1);
+
+    proc.by_argc.assign(table_size, 0);
+
+    for (size_t clause = arities.size(); clause-- > 0;) {
+        size_t required = arities[clause].first;
+        bool has_rest = arities[clause].second;
+
+        if (has_rest) {
+            for (size_t argc = required; argc < table_size; ++argc)
+                proc.by_argc[argc] = uint16_t(clause + 1);
+
+            proc.rest_clause = uint16_t(clause + 1);
+        } else {
+            proc.by_argc[required] = uint16_t(clause + 1);
+        }
+    }
+
+    return object_allocate<case_lambda_t>(case_lambda_metaobject(), std::move(proc));
+}
+
+bool is_case_lambda(value val)
+{
+    return magic::has_type_tag(val, type_tag_case_lambda);
+}
+
+value case_lambda_select(value proc, value argl)
+{
+    check_type(is_case_lambda, proc, "case_lambda_select: expected case-lambda procedure");
+    auto data = object_data_as<case_lambda_t *>(proc);
+
+    size_t argc = 0;
+    for (value arg = argl; is_pair(arg); arg = cdr(arg))
+        ++argc;
+
+    uint16_t clause = argc < data->by_argc.size() ? data->by_argc[argc]
+                                                  : data->rest_clause;
+
+    if (clause == 0)
+        throw noldor::call_error("case-lambda: no clause accepts arguments", argl);
+
+    return data->clauses[clause - 1];
+}
+
+struct control_procedure_t {
+    std::string name;
+    uint64_t label;
+};
+
+static void control_procedure_destruct(value self)
+{
+    object_data_as<control_procedure_t *>(self)->~control_procedure_t();
+}
+
+static void control_procedure_gc_visit(value, gc_visit_fn_t, void*)
+{}
+
+static std::string control_procedure_repr(value val)
+{
+    return "<#control-procedure " + object_data_as<control_procedure_t *>(val)->name + ">";
+}
+
+static metatype_t *control_procedure_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        control_procedure_destruct,
+        control_procedure_gc_visit,
+        control_procedure_repr,
+        type_tag_control_procedure
+    };
+
+    return &metaobject;
+}
+
+value mk_control_procedure(std::string name, uint64_t label)
+{
+    return object_allocate<control_procedure_t>(control_procedure_metaobject(), { std::move(name), label });
+}
+
+bool is_control_procedure(value val)
+{
+    return magic::has_type_tag(val, type_tag_control_procedure);
+}
+
+uint64_t control_procedure_label(value proc)
+{
+    check_type(is_control_procedure, proc, "control_procedure_label: expected control procedure");
+    return object_data_as<control_procedure_t *>(proc)->label;
+}
+
 bool is_procedure(value val)
 {
-    return is_primitive_procedure(val) || is_compound_procedure(val);
+    return is_primitive_procedure(val) || is_compound_procedure(val)
+        || is_case_lambda(val) || is_control_procedure(val)
+        || is_continuation(val) || is_composable_continuation(val);
 }
 
 }
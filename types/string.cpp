@@ -23,7 +23,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 */
 
-#include "noldor.h"
+#include "noldor_impl.h"
 #include <string>
 
 namespace noldor {
@@ -34,7 +34,9 @@ struct string_t {
 
 static void string_destruct(value obj)
 {
-    object_data_as<string_t *>(obj)->~string_t();
+    auto *s = object_data_as<string_t *>(obj);
+    gc_account_external(-ptrdiff_t(s->string.capacity()));
+    s->~string_t();
 }
 
 static void string_gc_visit(value, gc_visit_fn_t, void *)
@@ -52,7 +54,8 @@ static metatype_t *string_metaobject()
         typeflags_self_eval,
         string_destruct,
         string_gc_visit,
-        string_repr
+        string_repr,
+        type_tag_string
     };
 
     return &metaobject;
@@ -60,12 +63,13 @@ static metatype_t *string_metaobject()
 
 value mk_string(std::string s)
 {
+    gc_account_external(ptrdiff_t(s.capacity()));
     return object_allocate<string_t>(string_metaobject(), { std::move(s) } );
 }
 
 bool is_string(value v)
 {
-    return object_metaobject(v) == string_metaobject();
+    return magic::has_type_tag(v, type_tag_string);
 }
 
 std::string string_get(value val)
@@ -23,14 +23,24 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 */
 
-#include "noldor.h"
+#include "noldor_impl.h"
 #include <unordered_map>
+#include <mutex>
+#include <pthread.h>
 
 namespace noldor {
 
+// Symbols live outside every isolate's heap, shared by all of them. Those
+// that string->symbol makes at runtime are weak: every isolate holding one
+// lists it, and drops it once a full collection of its heap finds it
+// unreached. The last isolate to drop it frees it. Interning a name any
+// other way, as the reader and the runtime do, makes its symbol permanent.
 struct symbol_t {
     std::string name;
-    std::size_t hash;
+    std::atomic<bool> weak;
+    uint32_t n_holders = 0;     // isolates listing it, under the symbol mutex
+
+    symbol_t(std::string n, bool w) : name(std::move(n)), weak(w) {}
 };
 
 static void symbol_destruct(value obj)
@@ -53,37 +63,96 @@ static metatype_t *symbol_metaobject()
         typeflags_static,
         symbol_destruct,
         symbol_gc_visit,
-        symbol_repr
+        symbol_repr,
+        type_tag_symbol
     };
 
     return &metaobject;
 }
 
-static std::unordered_map<std::size_t, value> *interned_symbols()
+static std::unordered_map<std::string, value> *interned_symbols()
 {
-    static std::unordered_map<std::size_t, value> table;
+    static std::unordered_map<std::string, value> table;
     return &table;
 }
 
-value symbol(std::string s)
+static std::mutex &symbol_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// a child forked while another thread interns must not inherit a held lock
+static int symbol_atfork = pthread_atfork([] { symbol_mutex().lock(); },
+                                          [] { symbol_mutex().unlock(); },
+                                          [] { symbol_mutex().unlock(); });
+
+static value intern(std::string s, bool weak)
 {
-    auto hash = std::hash<std::string>{}(s);
     auto interned = interned_symbols();
 
-    auto it = interned->find(hash);
+    std::lock_guard<std::mutex> lock(symbol_mutex());
+
+    auto it = interned->find(s);
 
-    if (it != interned->end())
-        return it->second;
+    if (it == interned->end()) {
+        value symval = allocate(symbol_metaobject(), sizeof(symbol_t), alignof(symbol_t));
+        new (object_data(symval)) symbol_t(s, weak);
+        it = interned->emplace(std::move(s), symval).first;
+    }
 
-    auto symval = object_allocate<symbol_t>(symbol_metaobject(), symbol_t { std::move(s), hash });
-    interned->emplace(hash, symval);
+    value symval = it->second;
+    auto sym = object_data_as<symbol_t *>(symval);
+
+    if (!weak)
+        sym->weak = false;
+    else if (sym->weak && globals::isolate()->weak_symbols.insert(uint64_t(symval)).second)
+        sym->n_holders++;
 
     return symval;
 }
 
+value symbol(std::string s)
+{
+    return intern(std::move(s), false);
+}
+
+value string_to_symbol(std::string s)
+{
+    return intern(std::move(s), true);
+}
+
+bool is_weak_symbol(value sym)
+{
+    return object_data_as<symbol_t *>(sym)->weak.load(std::memory_order_relaxed);
+}
+
+void release_weak_symbols(isolate_t *isolate, const std::unordered_set<uint64_t> *reached)
+{
+    auto interned = interned_symbols();
+
+    std::lock_guard<std::mutex> lock(symbol_mutex());
+
+    for (auto it = isolate->weak_symbols.begin(); it != isolate->weak_symbols.end();) {
+        if (reached && reached->count(*it)) {
+            ++it;
+            continue;
+        }
+
+        value symval = value(*it);
+        auto sym = object_data_as<symbol_t *>(symval);
+        it = isolate->weak_symbols.erase(it);
+
+        if (--sym->n_holders == 0 && sym->weak.load()) {
+            interned->erase(sym->name);
+            free_static(symval);
+        }
+    }
+}
+
 bool is_symbol(value v)
 {
-    return object_metaobject(v) == symbol_metaobject();
+    return magic::has_type_tag(v, type_tag_symbol);
 }
 
 std::string symbol_to_string(value v)
@@ -0,0 +1,120 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+#include "noldor_impl.h"
+
+#include <sstream>
+
+namespace noldor {
+
+static void green_thread_destruct(value self)
+{
+    object_data_as<green_thread_t *>(self)->~green_thread_t();
+}
+
+static void green_thread_gc_visit(value self, gc_visit_fn_t visitor, void *data)
+{
+    auto t = object_data_as<green_thread_t *>(self);
+    visitor(&t->thunk, data);
+    visitor(&t->name, data);
+    visitor(&t->result, data);
+    visitor(&t->joiners, data);
+    visitor(&t->joining, data);
+    visitor(&t->connecting, data);
+
+    // the stack of an outermost run is rooted by the run itself
+    if (t->owned)
+        t->owned->visit(visitor, data);
+}
+
+static std::string green_thread_repr(value self)
+{
+    auto t = object_data_as<green_thread_t *>(self);
+
+    std::stringstream stream;
+    stream << "<#thread";
+
+    if (!is_null(t->name))
+        stream << " " << printable(t->name);
+
+    stream << ">";
+    return stream.str();
+}
+
+static metatype_t *green_thread_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_remembered,
+        green_thread_destruct,
+        green_thread_gc_visit,
+        green_thread_repr,
+        type_tag_thread
+    };
+
+    return &metaobject;
+}
+
+value make_thread(value thunk, dot_tag, value name)
+{
+    check_type(is_procedure, thunk, "make-thread: expected procedure");
+
+    green_thread_t t;
+    t.owned.reset(new thread_t);
+    t.thread = t.owned.get();
+    t.thunk = thunk;
+    t.name = is_null(name) ? name : car(name);
+
+    return object_allocate<green_thread_t>(green_thread_metaobject(), std::move(t));
+}
+
+value mk_primordial_thread(thread_t &thread)
+{
+    green_thread_t t;
+    t.thread = &thread;
+    t.name = SYMBOL_LITERAL(primordial);
+    t.status = green_thread_runnable;
+
+    return object_allocate<green_thread_t>(green_thread_metaobject(), std::move(t));
+}
+
+bool is_thread(value val)
+{
+    return magic::has_type_tag(val, type_tag_thread);
+}
+
+green_thread_t *green_thread_data(value t)
+{
+    check_type(is_thread, t, "expected thread");
+    return object_data_as<green_thread_t *>(t);
+}
+
+value thread_name(value t)
+{
+    return green_thread_data(t)->name;
+}
+
+}
@@ -0,0 +1,72 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "noldor_impl.h"
+
+namespace noldor {
+
+// marks the val register as holding multiple values, see ctl_values
+
+struct values_t {};
+
+static void values_destruct(value self)
+{
+    object_data_as<values_t *>(self)->~values_t();
+}
+
+static void values_gc_visit(value, gc_visit_fn_t, void*)
+{}
+
+static std::string values_repr(value)
+{
+    return "<#values>";
+}
+
+static metatype_t *values_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_static,
+        values_destruct,
+        values_gc_visit,
+        values_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+value values_marker()
+{
+    static value v = object_allocate<values_t>(values_metaobject(), {});
+    return v;
+}
+
+bool is_values_marker(value val)
+{
+    return eq(val, values_marker());
+}
+
+}
@@ -23,9 +23,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 */
 
-#include "noldor.h"
+#include "noldor_impl.h"
 #include <vector>
 #include <numeric>
+#include <chrono>
 
 namespace noldor {
 
@@ -35,7 +36,9 @@ struct vector_t {
 
 static void vector_destruct(value obj)
 {
-    object_data_as<vector_t *>(obj)->~vector_t();
+    auto *v = object_data_as<vector_t *>(obj);
+    gc_account_external(-ptrdiff_t(v->elements.capacity() * sizeof(value)));
+    v->~vector_t();
 }
 
 static void vector_gc_visit(value self, gc_visit_fn_t visitor, void *data)
@@ -63,10 +66,11 @@ static metatype_t *vector_metaobject()
 {
     static metatype_t metaobject = {
         METATYPE_VERSION,
-        typeflags_self_eval,
+        typeflags(typeflags_self_eval | typeflags_movable),
         vector_destruct,
         vector_gc_visit,
-        vector_repr
+        vector_repr,
+        type_tag_vector
     };
 
     return &metaobject;
@@ -74,12 +78,13 @@ static metatype_t *vector_metaobject()
 
 value mk_vector(std::vector<value> elements)
 {
+    gc_account_external(ptrdiff_t(elements.capacity() * sizeof(value)));
     return object_allocate<vector_t>(vector_metaobject(), { std::move(elements) });
 }
 
 bool is_vector(value v)
 {
-    return object_metaobject(v) == vector_metaobject();
+    return magic::has_type_tag(v, type_tag_vector);
 }
 
 std::vector<value> vector_get(value vec)
@@ -87,4 +92,172 @@ std::vector<value> vector_get(value vec)
     return object_data_as<vector_t *>(vec)->elements;
 }
 
+value make_vector(int32_t k, dot_tag, value fill)
+{
+    if (k < 0)
+        throw type_error("make-vector: expected non-negative length", mk_int(k));
+
+    return mk_vector(std::vector<value>(size_t(k), is_null(fill) ? mk_bool(false) : car(fill)));
+}
+
+int32_t vector_length(value vec)
+{
+    check_type(is_vector, vec, "vector-length: expected vector");
+    return int32_t(object_data_as<vector_t *>(vec)->elements.size());
+}
+
+static value &vector_slot(value vec, int32_t k, const char *who)
+{
+    check_type(is_vector, vec, who);
+    auto &elements = object_data_as<vector_t *>(vec)->elements;
+
+    if (k < 0 || size_t(k) >= elements.size())
+        throw type_error(std::string(who) + ": index out of range", mk_int(k));
+
+    return elements[size_t(k)];
+}
+
+value vector_ref(value vec, int32_t k)
+{
+    return vector_slot(vec, k, "vector-ref");
+}
+
+value vector_set(value vec, int32_t k, value val)
+{
+    gc_store(&vector_slot(vec, k, "vector-set!"), val);
+    gc_write_barrier(vec);
+    return val;
+}
+
+// The parallel operations first work through the vector on the calling
+// thread just long enough to time an element, then hand out the rest as
+// futures of about CHUNK_TARGET's worth of work each, or fewer if that
+// would leave some workers without a chunk. Results are combined in order.
+
+enum chunk_mode {
+    chunk_map,
+    chunk_for_each,
+    chunk_reduce
+};
+
+using chunk_clock = std::chrono::steady_clock;
+
+static const auto CHUNK_PROBE = std::chrono::microseconds(50);
+static const auto CHUNK_TARGET = std::chrono::microseconds(250);
+
+static value run_chunk(chunk_mode mode, value proc, value vec, value out, size_t start, size_t end, value acc)
+{
+    basic_scope roots { &proc, &vec, &out, &acc };
+
+    for (size_t i = start; i < end; ++i) {
+        value element = object_data_as<vector_t *>(vec)->elements[i];
+
+        switch (mode) {
+        case chunk_map: {
+            value result = apply(proc, {}, list(element));
+            gc_store(&object_data_as<vector_t *>(out)->elements[i], result);
+            gc_write_barrier(out);
+            break;
+        }
+        case chunk_for_each:
+            apply(proc, {}, list(element));
+            break;
+        case chunk_reduce:
+            acc = apply(proc, {}, list(acc, element));
+            break;
+        }
+    }
+
+    return acc;
+}
+
+// (mode proc vec out start end acc)
+static value vector_chunk(value argl)
+{
+    value args[7] = { list(), list(), list(), list(), list(), list(), list() };
+
+    for (value &arg : args) {
+        arg = car(argl);
+        argl = cdr(argl);
+    }
+
+    return run_chunk(chunk_mode(to_int(args[0])), args[1], args[2], args[3],
+                     size_t(to_int(args[4])), size_t(to_int(args[5])), args[6]);
+}
+
+static value vector_par(const char *who, chunk_mode mode, value proc, value vec, value out, value identity)
+{
+    check_type(is_procedure, proc, who);
+    check_type(is_vector, vec, who);
+
+    size_t n = object_data_as<vector_t *>(vec)->elements.size();
+    value acc = identity;
+    value futures = list();
+    basic_scope roots { &proc, &vec, &out, &identity, &acc, &futures };
+
+    size_t probed = 0;
+    auto start = chunk_clock::now();
+    auto elapsed = chunk_clock::duration::zero();
+
+    while (probed < n && elapsed < CHUNK_PROBE) {
+        acc = run_chunk(mode, proc, vec, out, probed, probed + 1, acc);
+        probed++;
+        elapsed = chunk_clock::now() - start;
+    }
+
+    if (probed == n)
+        return acc;
+
+    using seconds = std::chrono::duration<double>;
+    double per_element = std::max(seconds(elapsed).count() / double(probed), 1e-9);
+    size_t per_target = size_t(seconds(CHUNK_TARGET).count() / per_element);
+    size_t n_threads = work_pool_size() + 1;
+    size_t chunk = std::max<size_t>(1, std::min(per_target, (n - probed + n_threads - 1) / n_threads));
+
+    value chunker = mk_primitive_procedure("vector-chunk", vector_chunk);
+    basic_scope chunker_root { &chunker };
+
+    for (size_t i = probed; i < n; i += chunk) {
+        value args = list(mk_int(mode), proc, vec, out, mk_int(int32_t(i)), mk_int(int32_t(std::min(i + chunk, n))), identity);
+        futures = cons(make_future(chunker, {}, args), futures);
+    }
+
+    futures = reverse(futures);
+
+    value f = futures;
+    basic_scope f_root { &f };
+
+    for (; is_pair(f); f = cdr(f)) {
+        value result = touch(car(f));
+
+        if (mode == chunk_reduce)
+            acc = apply(proc, {}, list(acc, result));
+    }
+
+    return acc;
+}
+
+value vector_map_par(value proc, value vec)
+{
+    check_type(is_vector, vec, "vector-map/par: expected vector");
+
+    value out = mk_vector(std::vector<value>(object_data_as<vector_t *>(vec)->elements.size(), list()));
+    basic_scope roots { &out };
+
+    vector_par("vector-map/par: expected procedure and vector", chunk_map, proc, vec, out, list());
+    return out;
+}
+
+value vector_for_each_par(value proc, value vec)
+{
+    vector_par("vector-for-each/par: expected procedure and vector", chunk_for_each, proc, vec, list(), list());
+    return vec;
+}
+
+// proc must be associative with identity as its identity element
+value vector_reduce_par(value proc, value identity, value vec)
+{
+    return vector_par("vector-reduce/par: expected procedure and vector", chunk_reduce, proc, vec, list(), identity);
+}
+
 }
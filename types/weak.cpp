@@ -0,0 +1,434 @@
+/*
+
+Copyright (c) 2016 Louai Al-Khanji
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "noldor_impl.h"
+
+#include <deque>
+
+namespace noldor {
+
+// A weak box lets go of its value once nothing else holds it. An ephemeron
+// holds its datum only for as long as something else holds its key, and a
+// weak table is a set of ephemerons looked up by key identity, as eq? sees
+// it. None of them trace anything themselves; the collector settles them
+// after marking, see gc_register_weak. A guardian hands back the objects
+// registered with it once they die, brought back to life, in the order the
+// collector found them dead.
+
+struct weak_box_t {
+    value target = list();
+    bool broken = false;
+};
+
+struct ephemeron_t {
+    value key = list();
+    value datum = list();
+    bool broken = false;
+};
+
+struct weak_table_t {
+    std::unordered_map<uint64_t, value> entries;
+    std::unique_ptr<std::mutex> mutex = std::make_unique<std::mutex>();
+};
+
+struct guardian_t {
+    std::vector<value> tracked;     // held weakly
+    std::deque<value> ready;
+    std::unique_ptr<std::mutex> mutex = std::make_unique<std::mutex>();
+};
+
+static void weak_box_destruct(value self)
+{
+    object_data_as<weak_box_t *>(self)->~weak_box_t();
+}
+
+static std::string weak_box_repr(value)
+{
+    return "<#weak-box>";
+}
+
+static metatype_t *weak_box_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        weak_box_destruct,
+        nullptr,
+        weak_box_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+static void ephemeron_destruct(value self)
+{
+    object_data_as<ephemeron_t *>(self)->~ephemeron_t();
+}
+
+static std::string ephemeron_repr(value)
+{
+    return "<#ephemeron>";
+}
+
+static metatype_t *ephemeron_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        ephemeron_destruct,
+        nullptr,
+        ephemeron_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+static void weak_table_destruct(value self)
+{
+    object_data_as<weak_table_t *>(self)->~weak_table_t();
+}
+
+static std::string weak_table_repr(value)
+{
+    return "<#weak-table>";
+}
+
+static metatype_t *weak_table_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_none,
+        weak_table_destruct,
+        nullptr,
+        weak_table_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+static void guardian_destruct(value self)
+{
+    object_data_as<guardian_t *>(self)->~guardian_t();
+}
+
+static void guardian_gc_visit(value self, gc_visit_fn_t visitor, void *data)
+{
+    for (value &obj : object_data_as<guardian_t *>(self)->ready)
+        visitor(&obj, data);
+}
+
+static std::string guardian_repr(value)
+{
+    return "<#guardian>";
+}
+
+static metatype_t *guardian_metaobject()
+{
+    static metatype_t metaobject = {
+        METATYPE_VERSION,
+        typeflags_remembered,
+        guardian_destruct,
+        guardian_gc_visit,
+        guardian_repr,
+        type_tag_none
+    };
+
+    return &metaobject;
+}
+
+void weak_trace(value obj, gc_live_fn_t is_live, void *live_data, gc_visit_fn_t visitor, void *data)
+{
+    metatype_t *metaobject = object_metaobject(obj);
+
+    if (metaobject == ephemeron_metaobject()) {
+        auto e = object_data_as<ephemeron_t *>(obj);
+
+        if (is_live(e->key, live_data))
+            visitor(&e->datum, data);
+    } else if (metaobject == weak_table_metaobject()) {
+        for (auto &entry : object_data_as<weak_table_t *>(obj)->entries) {
+            if (is_live(value(entry.first), live_data))
+                visitor(&entry.second, data);
+        }
+    }
+}
+
+void weak_resurrect(value obj, gc_live_fn_t is_live, void *live_data, gc_visit_fn_t visitor, void *data)
+{
+    if (object_metaobject(obj) != guardian_metaobject())
+        return;
+
+    auto g = object_data_as<guardian_t *>(obj);
+    size_t n_kept = 0;
+
+    for (value tracked : g->tracked) {
+        if (is_live(tracked, live_data)) {
+            g->tracked[n_kept++] = tracked;
+        } else {
+            g->ready.push_back(tracked);
+            visitor(&g->ready.back(), data);
+        }
+    }
+
+    g->tracked.erase(g->tracked.begin() + ptrdiff_t(n_kept), g->tracked.end());
+}
+
+void weak_clear(value obj, gc_live_fn_t is_live, void *live_data)
+{
+    metatype_t *metaobject = object_metaobject(obj);
+
+    if (metaobject == weak_box_metaobject()) {
+        auto box = object_data_as<weak_box_t *>(obj);
+
+        if (!box->broken && !is_live(box->target, live_data)) {
+            box->target = list();
+            box->broken = true;
+        }
+    } else if (metaobject == ephemeron_metaobject()) {
+        auto e = object_data_as<ephemeron_t *>(obj);
+
+        if (!e->broken && !is_live(e->key, live_data)) {
+            e->key = list();
+            e->datum = list();
+            e->broken = true;
+        }
+    } else if (metaobject == weak_table_metaobject()) {
+        auto &entries = object_data_as<weak_table_t *>(obj)->entries;
+
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (is_live(value(it->first), live_data))
+                ++it;
+            else
+                it = entries.erase(it);
+        }
+    }
+}
+
+void weak_visit(value obj, gc_visit_fn_t visitor, void *data)
+{
+    metatype_t *metaobject = object_metaobject(obj);
+
+    if (metaobject == weak_box_metaobject()) {
+        visitor(&object_data_as<weak_box_t *>(obj)->target, data);
+    } else if (metaobject == ephemeron_metaobject()) {
+        auto e = object_data_as<ephemeron_t *>(obj);
+        visitor(&e->key, data);
+        visitor(&e->datum, data);
+    } else if (metaobject == weak_table_metaobject()) {
+        auto &entries = object_data_as<weak_table_t *>(obj)->entries;
+
+        // a key that moved hashes elsewhere
+        std::unordered_map<uint64_t, value> moved;
+        moved.reserve(entries.size());
+
+        for (auto &entry : entries) {
+            value key = value(entry.first);
+            visitor(&key, data);
+            visitor(&entry.second, data);
+            moved.emplace(key, entry.second);
+        }
+
+        entries.swap(moved);
+    } else if (metaobject == guardian_metaobject()) {
+        for (value &tracked : object_data_as<guardian_t *>(obj)->tracked)
+            visitor(&tracked, data);
+    }
+}
+
+value make_weak_box(value target)
+{
+    weak_box_t box;
+    box.target = target;
+
+    value self = object_allocate<weak_box_t>(weak_box_metaobject(), std::move(box));
+    gc_register_weak(self);
+
+    return self;
+}
+
+bool is_weak_box(value val)
+{
+    return object_metaobject(val) == weak_box_metaobject();
+}
+
+value weak_box_value(value box, dot_tag, value fallback)
+{
+    check_type(is_weak_box, box, "weak-box-value: expected weak box");
+
+    auto data = object_data_as<weak_box_t *>(box);
+
+    if (data->broken)
+        return is_null(fallback) ? mk_bool(false) : car(fallback);
+
+    return data->target;
+}
+
+value make_ephemeron(value key, value datum)
+{
+    ephemeron_t e;
+    e.key = key;
+    e.datum = datum;
+
+    value self = object_allocate<ephemeron_t>(ephemeron_metaobject(), std::move(e));
+    gc_register_weak(self);
+
+    return self;
+}
+
+bool is_ephemeron(value val)
+{
+    return object_metaobject(val) == ephemeron_metaobject();
+}
+
+value ephemeron_key(value e)
+{
+    check_type(is_ephemeron, e, "ephemeron-key: expected ephemeron");
+
+    auto data = object_data_as<ephemeron_t *>(e);
+    return data->broken ? mk_bool(false) : data->key;
+}
+
+value ephemeron_datum(value e)
+{
+    check_type(is_ephemeron, e, "ephemeron-datum: expected ephemeron");
+
+    auto data = object_data_as<ephemeron_t *>(e);
+    return data->broken ? mk_bool(false) : data->datum;
+}
+
+bool is_ephemeron_broken(value e)
+{
+    check_type(is_ephemeron, e, "ephemeron-broken?: expected ephemeron");
+    return object_data_as<ephemeron_t *>(e)->broken;
+}
+
+value make_weak_table()
+{
+    value self = object_allocate<weak_table_t>(weak_table_metaobject(), weak_table_t {});
+    gc_register_weak(self);
+
+    return self;
+}
+
+bool is_weak_table(value val)
+{
+    return object_metaobject(val) == weak_table_metaobject();
+}
+
+value weak_table_ref(value table, value key, dot_tag, value fallback)
+{
+    check_type(is_weak_table, table, "weak-table-ref: expected weak table");
+
+    auto data = object_data_as<weak_table_t *>(table);
+    std::lock_guard<std::mutex> lock(*data->mutex);
+
+    auto it = data->entries.find(key);
+
+    if (it != data->entries.end())
+        return it->second;
+
+    return is_null(fallback) ? mk_bool(false) : car(fallback);
+}
+
+value weak_table_set(value table, value key, value val)
+{
+    check_type(is_weak_table, table, "weak-table-set!: expected weak table");
+
+    auto data = object_data_as<weak_table_t *>(table);
+    std::lock_guard<std::mutex> lock(*data->mutex);
+
+    auto it = data->entries.find(key);
+
+    if (it != data->entries.end())
+        it->second = val;
+    else
+        data->entries.emplace(key, val);
+
+    return val;
+}
+
+value weak_table_delete(value table, value key)
+{
+    check_type(is_weak_table, table, "weak-table-delete!: expected weak table");
+
+    auto data = object_data_as<weak_table_t *>(table);
+    std::lock_guard<std::mutex> lock(*data->mutex);
+
+    return mk_bool(data->entries.erase(key) != 0);
+}
+
+int weak_table_count(value table)
+{
+    check_type(is_weak_table, table, "weak-table-count: expected weak table");
+
+    auto data = object_data_as<weak_table_t *>(table);
+    std::lock_guard<std::mutex> lock(*data->mutex);
+
+    return int(data->entries.size());
+}
+
+value make_guardian()
+{
+    value self = object_allocate<guardian_t>(guardian_metaobject(), guardian_t {});
+    gc_register_weak(self);
+
+    return self;
+}
+
+bool is_guardian(value val)
+{
+    return object_metaobject(val) == guardian_metaobject();
+}
+
+value guardian_register(value guardian, value obj)
+{
+    check_type(is_guardian, guardian, "guardian-register!: expected guardian");
+
+    auto g = object_data_as<guardian_t *>(guardian);
+    std::lock_guard<std::mutex> lock(*g->mutex);
+
+    g->tracked.push_back(obj);
+    return obj;
+}
+
+value guardian_collect(value guardian)
+{
+    check_type(is_guardian, guardian, "guardian-collect: expected guardian");
+
+    auto g = object_data_as<guardian_t *>(guardian);
+    std::lock_guard<std::mutex> lock(*g->mutex);
+
+    if (g->ready.empty())
+        return mk_bool(false);
+
+    value obj = g->ready.front();
+    g->ready.pop_front();
+    return obj;
+}
+
+}